@@ -2,15 +2,73 @@
 #define RUST_STREAMS_H
 
 #include<tuple>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <cerrno>
+#include <system_error>
+#include <stdexcept>
+
+// fromMappedFile() is available where POSIX mmap() is
+#if defined __unix__ || defined __APPLE__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define STREAMS_HAS_MMAP 1
+#endif
 
 #if defined _MSC_VER
 #include "Optional/optional.hpp"
+// std::string_view needs /std:c++17, a minimal StringView below stands in for it otherwise
+#if defined _MSVC_LANG && _MSVC_LANG >= 201703L
+#include <string_view>
+#define STREAMS_HAS_STD_STRING_VIEW 1
+#endif
 #define CONSTEXPR
 # else
 #include <experimental/optional>
+#include <experimental/string_view>
 #define CONSTEXPR constexpr
 #endif
 
+// True while a CONSTEXPR function is evaluated at compile time. Terminal operations then pull elements
+// in plain loops, as C++14 doesn't allow lambdas in constant expressions. Without the builtin they
+// can't be evaluated at compile time, STREAMS_HAS_CONSTANT_EVALUATION tells whether they can.
+#if defined __clang__
+#  if __has_builtin(__builtin_is_constant_evaluated)
+#    define STREAMS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#    define STREAMS_HAS_CONSTANT_EVALUATION 1
+#  endif
+#elif defined __GNUC__ && __GNUC__ >= 9
+#  define STREAMS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#  define STREAMS_HAS_CONSTANT_EVALUATION 1
+#endif
+#ifndef STREAMS_CONSTANT_EVALUATED
+#  define STREAMS_CONSTANT_EVALUATED() false
+#endif
+
+#if defined __AVX2__ || defined __SSE2__ || (defined _M_IX86_FP && _M_IX86_FP >= 2) || defined _M_X64
+#include <immintrin.h>
+#endif
+
 namespace streams {
 
     template<typename T>
@@ -18,7 +76,117 @@ namespace streams {
 
     using std::experimental::nullopt;
 
+#if defined STREAMS_HAS_STD_STRING_VIEW
+    using StringView = std::string_view;
+#elif !defined _MSC_VER
+    using StringView = std::experimental::string_view;
+#else
+    // npos lives in a template so that the header can define it
+    template<typename = void>
+    struct StringViewBase {
+        static constexpr size_t npos = size_t(-1);
+    };
+    template<typename T>
+    constexpr size_t StringViewBase<T>::npos;
+
+    // The part of std::string_view the library and its users need: a pointer and a length into text
+    // owned elsewhere.
+    class StringView : public StringViewBase<> {
+    public:
+        using value_type = char;
+        using size_type = size_t;
+        using const_iterator = const char*;
+
+        constexpr StringView() noexcept = default;
+        constexpr StringView(const char* data, size_t size) noexcept : ptr(data), length(size) {}
+        StringView(const char* text) noexcept : ptr(text), length(std::strlen(text)) {}
+        template<typename Traits, typename Allocator>
+        StringView(const std::basic_string<char, Traits, Allocator>& text) noexcept : ptr(text.data()), length(text.size()) {}
+
+        template<typename Traits, typename Allocator>
+        explicit operator std::basic_string<char, Traits, Allocator>() const {
+            return std::basic_string<char, Traits, Allocator>(ptr, length);
+        }
+
+        constexpr const char* data() const noexcept { return ptr; }
+        constexpr size_t size() const noexcept { return length; }
+        constexpr bool empty() const noexcept { return length == 0; }
+        constexpr const char* begin() const noexcept { return ptr; }
+        constexpr const char* end() const noexcept { return ptr + length; }
+        constexpr char operator[](size_t i) const { return ptr[i]; }
+        constexpr char front() const { return ptr[0]; }
+        constexpr char back() const { return ptr[length - 1]; }
+
+        void remove_prefix(size_t n) { ptr += n; length -= n; }
+        void remove_suffix(size_t n) { length -= n; }
+
+        StringView substr(size_t pos, size_t count = npos) const {
+            if (pos > length) {
+                throw std::out_of_range("StringView::substr");
+            }
+            return StringView(ptr + pos, std::min(count, length - pos));
+        }
+
+        int compare(StringView other) const noexcept {
+            const int result = length == 0 || other.length == 0 ? 0 : std::memcmp(ptr, other.ptr, std::min(length, other.length));
+            return result != 0 ? result : (length < other.length ? -1 : (length > other.length ? 1 : 0));
+        }
+
+        size_t find(StringView needle, size_t pos = 0) const noexcept {
+            for (; pos + needle.length <= length; ++pos) {
+                if (needle.length == 0 || std::memcmp(ptr + pos, needle.ptr, needle.length) == 0) {
+                    return pos;
+                }
+            }
+            return npos;
+        }
+        size_t find(char c, size_t pos = 0) const noexcept {
+            const void* found = pos < length ? std::memchr(ptr + pos, c, length - pos) : nullptr;
+            return found ? static_cast<size_t>(static_cast<const char*>(found) - ptr) : npos;
+        }
+        size_t rfind(StringView needle, size_t pos = npos) const noexcept {
+            if (needle.length > length) {
+                return npos;
+            }
+            for (size_t i = std::min(pos, length - needle.length) + 1; i-- > 0;) {
+                if (needle.length == 0 || std::memcmp(ptr + i, needle.ptr, needle.length) == 0) {
+                    return i;
+                }
+            }
+            return npos;
+        }
+        size_t rfind(char c, size_t pos = npos) const noexcept {
+            return rfind(StringView(&c, 1), pos);
+        }
+
+        friend bool operator==(StringView a, StringView b) noexcept { return a.length == b.length && a.compare(b) == 0; }
+        friend bool operator!=(StringView a, StringView b) noexcept { return !(a == b); }
+        friend bool operator<(StringView a, StringView b) noexcept { return a.compare(b) < 0; }
+        friend bool operator>(StringView a, StringView b) noexcept { return b < a; }
+        friend bool operator<=(StringView a, StringView b) noexcept { return !(b < a); }
+        friend bool operator>=(StringView a, StringView b) noexcept { return !(a < b); }
+
+        template<typename Stream>
+        friend auto operator<<(Stream& stream, StringView view) -> decltype(stream.write(view.data(), 0)) {
+            return stream.write(view.ptr, static_cast<std::make_signed_t<size_t>>(view.length));
+        }
+
+    private:
+        const char* ptr = nullptr;
+        size_t length = 0;
+    };
+#endif
+
+    template<typename ExtractorType>
+    struct BaseStreamInterface;
+
     namespace traits {
+        template<typename T>
+        struct IsStream : std::false_type {};
+
+        template<typename ExtractorType>
+        struct IsStream<BaseStreamInterface<ExtractorType>> : std::true_type {};
+
         template<typename Type>
         constexpr bool IsOptional() {
             using T = typename Type::value_type;
@@ -28,672 +196,4636 @@ namespace streams {
         template<typename Extractor>
         using ValueType = std::decay_t<decltype(*(std::declval<Extractor>().get()))>;
 
+        template<typename Extractor>
+        using ConstReference = const std::remove_reference_t<decltype(*(std::declval<Extractor>().get()))>&;
+
         template<typename Extractor, typename Functor>
         using ApplyOnValueType = decltype(std::declval<Functor>()(std::declval<decltype(*(std::declval<Extractor>().get()))>()));
+
+        template<typename Container, typename = void>
+        struct HasReserve : std::false_type {};
+
+        template<typename Container>
+        struct HasReserve<Container, decltype(std::declval<Container&>().reserve(size_t{}))> : std::true_type {};
+
+        template<typename... Types>
+        struct AllSame : std::true_type {};
+
+        template<typename First, typename... Rest>
+        struct AllSame<First, Rest...> : std::integral_constant<bool, std::is_same<std::tuple<First, Rest...>, std::tuple<Rest..., First>>::value> {};
+
+        template<typename Iterator>
+        using IsRandomAccess = std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>;
+
+        // iterators known to walk over a contiguous block of memory
+        template<typename Iterator, typename Value = typename std::iterator_traits<Iterator>::value_type>
+        using IsContiguous = std::integral_constant<bool, !std::is_same<Value, bool>::value && (std::is_pointer<Iterator>::value
+            || std::is_same<Iterator, typename std::vector<Value>::iterator>::value
+            || std::is_same<Iterator, typename std::vector<Value>::const_iterator>::value
+            || std::is_same<Iterator, std::string::iterator>::value
+            || std::is_same<Iterator, std::string::const_iterator>::value)>;
+
+        // element types the block-wise (SIMD) path handles
+        template<typename Value>
+        using IsBlockwise = std::integral_constant<bool, std::is_arithmetic<Value>::value && !std::is_same<Value, bool>::value>;
+
+        template<typename Fold, typename Value>
+        using IsPlus = std::integral_constant<bool, std::is_same<std::decay_t<Fold>, std::plus<Value>>::value || std::is_same<std::decay_t<Fold>, std::plus<>>::value>;
     }
 
 
-    template <typename DerivedStreamExtractor>
-    struct StreamExtractor {
+    // Kernels for the block-wise path: they work on plain arrays of arithmetic values. sum/min/max have
+    // SSE2 (SSE4.1 for int min/max) and AVX2 versions for int, float and double, everything else is
+    // a branch-free scalar loop compilers can vectorize. Vectorized sums reassociate floating point
+    // additions, so they may differ from a sequential sum in the last bits.
+    namespace simd {
+        constexpr size_t BlockSize = 256;
 
-        auto get() noexcept(noexcept(std::declval<DerivedStreamExtractor>().get_impl())) {
-            return static_cast<DerivedStreamExtractor*>(this)->get_impl();
-        }
+        template<typename T>
+        struct Lanes {
+            static constexpr size_t width = 0;
+        };
 
-        bool advance() noexcept(noexcept(std::declval<DerivedStreamExtractor>().advance_impl())) {
-            return static_cast<DerivedStreamExtractor*>(this)->advance_impl();
-        }
-    };
+#if defined __AVX2__
+        template<>
+        struct Lanes<int> {
+            using type = __m256i;
+            static constexpr size_t width = 8;
+            static type load(const int* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+            static void store(int* p, type v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+            static type add(type a, type b) { return _mm256_add_epi32(a, b); }
+            static type min(type a, type b) { return _mm256_min_epi32(a, b); }
+            static type max(type a, type b) { return _mm256_max_epi32(a, b); }
+        };
 
-    template <typename IteratorType>
-    struct SequenceStreamExtractor : StreamExtractor<SequenceStreamExtractor<IteratorType>> {
-        SequenceStreamExtractor(IteratorType&& b, IteratorType&& e) 
-            : current(std::forward<IteratorType>(b)), next(std::forward<IteratorType>(b))
-            , begin(std::forward<IteratorType>(b)), end(std::forward<IteratorType>(e)) {}
+        template<>
+        struct Lanes<float> {
+            using type = __m256;
+            static constexpr size_t width = 8;
+            static type load(const float* p) { return _mm256_loadu_ps(p); }
+            static void store(float* p, type v) { _mm256_storeu_ps(p, v); }
+            static type add(type a, type b) { return _mm256_add_ps(a, b); }
+            static type min(type a, type b) { return _mm256_min_ps(a, b); }
+            static type max(type a, type b) { return _mm256_max_ps(a, b); }
+        };
 
-        IteratorType current;
-        IteratorType next;
-        const IteratorType begin;
-        const IteratorType end;
+        template<>
+        struct Lanes<double> {
+            using type = __m256d;
+            static constexpr size_t width = 4;
+            static type load(const double* p) { return _mm256_loadu_pd(p); }
+            static void store(double* p, type v) { _mm256_storeu_pd(p, v); }
+            static type add(type a, type b) { return _mm256_add_pd(a, b); }
+            static type min(type a, type b) { return _mm256_min_pd(a, b); }
+            static type max(type a, type b) { return _mm256_max_pd(a, b); }
+        };
+#elif defined __SSE2__ || (defined _M_IX86_FP && _M_IX86_FP >= 2) || defined _M_X64
+        // 32-bit min and max are SSE4.1, a comparison and a select stand in for them on plain SSE2
+        template<>
+        struct Lanes<int> {
+            using type = __m128i;
+            static constexpr size_t width = 4;
+            static type load(const int* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+            static void store(int* p, type v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+            static type add(type a, type b) { return _mm_add_epi32(a, b); }
+#if defined __SSE4_1__ || defined __AVX__
+            static type min(type a, type b) { return _mm_min_epi32(a, b); }
+            static type max(type a, type b) { return _mm_max_epi32(a, b); }
+#else
+            static type min(type a, type b) { return select(_mm_cmpgt_epi32(a, b), b, a); }
+            static type max(type a, type b) { return select(_mm_cmpgt_epi32(a, b), a, b); }
+            // `whenSet` where the mask is set, `otherwise` elsewhere
+            static type select(type mask, type whenSet, type otherwise) {
+                return _mm_or_si128(_mm_and_si128(mask, whenSet), _mm_andnot_si128(mask, otherwise));
+            }
+#endif
+        };
 
-        auto get_impl() noexcept {
-            return current;
+        template<>
+        struct Lanes<float> {
+            using type = __m128;
+            static constexpr size_t width = 4;
+            static type load(const float* p) { return _mm_loadu_ps(p); }
+            static void store(float* p, type v) { _mm_storeu_ps(p, v); }
+            static type add(type a, type b) { return _mm_add_ps(a, b); }
+            static type min(type a, type b) { return _mm_min_ps(a, b); }
+            static type max(type a, type b) { return _mm_max_ps(a, b); }
+        };
+
+        template<>
+        struct Lanes<double> {
+            using type = __m128d;
+            static constexpr size_t width = 2;
+            static type load(const double* p) { return _mm_loadu_pd(p); }
+            static void store(double* p, type v) { _mm_storeu_pd(p, v); }
+            static type add(type a, type b) { return _mm_add_pd(a, b); }
+            static type min(type a, type b) { return _mm_min_pd(a, b); }
+            static type max(type a, type b) { return _mm_max_pd(a, b); }
+        };
+#endif
+
+        struct Sum {
+            template<typename L, typename V> static V vector(V a, V b) { return L::add(a, b); }
+            template<typename T> static T scalar(T a, T b) { return static_cast<T>(a + b); }
+        };
+
+        struct Min {
+            template<typename L, typename V> static V vector(V a, V b) { return L::min(a, b); }
+            template<typename T> static T scalar(T a, T b) { return b < a ? b : a; }
+        };
+
+        struct Max {
+            template<typename L, typename V> static V vector(V a, V b) { return L::max(a, b); }
+            template<typename T> static T scalar(T a, T b) { return a < b ? b : a; }
+        };
+
+        template<typename Op, typename T>
+        T reduce(const T* data, size_t size, T init, std::false_type) {
+            // independent accumulators let the loop run without waiting on the previous addition
+            T acc[4] = { init, init, init, init };
+            size_t i = 0;
+            for (; i + 4 <= size; i += 4) {
+                acc[0] = Op::scalar(acc[0], data[i]);
+                acc[1] = Op::scalar(acc[1], data[i + 1]);
+                acc[2] = Op::scalar(acc[2], data[i + 2]);
+                acc[3] = Op::scalar(acc[3], data[i + 3]);
+            }
+            for (; i < size; ++i) {
+                acc[0] = Op::scalar(acc[0], data[i]);
+            }
+            return Op::scalar(Op::scalar(acc[0], acc[1]), Op::scalar(acc[2], acc[3]));
         }
 
-        bool advance_impl() {
-            if (next != end) {
-                current = next++;
-                return true;
-            } else {
-                return false;
+        template<typename Op, typename T>
+        T reduce(const T* data, size_t size, T init, std::true_type) {
+            using L = Lanes<T>;
+            constexpr size_t width = L::width;
+            if (size < 4 * width) {
+                return reduce<Op>(data, size, init, std::false_type{});
+            }
+            typename L::type acc[4] = { L::load(data), L::load(data + width), L::load(data + 2 * width), L::load(data + 3 * width) };
+            size_t i = 4 * width;
+            for (; i + 4 * width <= size; i += 4 * width) {
+                acc[0] = Op::template vector<L>(acc[0], L::load(data + i));
+                acc[1] = Op::template vector<L>(acc[1], L::load(data + i + width));
+                acc[2] = Op::template vector<L>(acc[2], L::load(data + i + 2 * width));
+                acc[3] = Op::template vector<L>(acc[3], L::load(data + i + 3 * width));
+            }
+            T lanes[width];
+            L::store(lanes, Op::template vector<L>(Op::template vector<L>(acc[0], acc[1]), Op::template vector<L>(acc[2], acc[3])));
+            T result = reduce<Op>(data + i, size - i, init, std::false_type{});
+            for (T lane : lanes) {
+                result = Op::scalar(result, lane);
             }
+            return result;
         }
-    };
 
-    template<typename ExtractorType>
-    struct SkipFirstStreamExtractor : StreamExtractor<SkipFirstStreamExtractor<ExtractorType>> {
-        SkipFirstStreamExtractor(ExtractorType extractor, size_t count) : source(extractor), skipCount(count) {}
+        template<typename T>
+        T sum(const T* data, size_t size) {
+            return reduce<Sum>(data, size, T{}, std::integral_constant<bool, Lanes<T>::width != 0>{});
+        }
 
-        ExtractorType source;
-        size_t skipCount;
+        // size > 0
+        template<typename T>
+        T min(const T* data, size_t size) {
+            return reduce<Min>(data, size, data[0], std::integral_constant<bool, Lanes<T>::width != 0>{});
+        }
 
-        auto get_impl() {
-            return source.get();
+        // size > 0
+        template<typename T>
+        T max(const T* data, size_t size) {
+            return reduce<Max>(data, size, data[0], std::integral_constant<bool, Lanes<T>::width != 0>{});
         }
 
-        bool advance_impl() {
-            while (skipCount != 0) {
-                --skipCount;
-                if (!source.advance()) {
-                    return false;
-                }
+        template<typename T, typename Predicate>
+        size_t countIf(const T* data, size_t size, Predicate& predicate) {
+            size_t count = 0;
+            for (size_t i = 0; i < size; ++i) {
+                count += static_cast<size_t>(static_cast<bool>(predicate(data[i])));
             }
-            return source.advance();
+            return count;
         }
 
-    };
+        // copies elements satisfying the predicate to `out`, returns their number
+        template<typename T, typename Predicate>
+        size_t compact(const T* data, size_t size, T* out, Predicate& predicate) {
+            size_t kept = 0;
+            for (size_t i = 0; i < size; ++i) {
+                out[kept] = data[i];
+                kept += static_cast<size_t>(static_cast<bool>(predicate(data[i])));
+            }
+            return kept;
+        }
+    }
 
-    template<typename ExtractorType, typename Predicate>
-    struct SkipWhileStreamExtractor : StreamExtractor<SkipWhileStreamExtractor<ExtractorType, Predicate>> {
-        SkipWhileStreamExtractor(ExtractorType extractor, Predicate&& predicate) : source(extractor), predicate(std::forward<Predicate>(predicate)) {}
 
-        ExtractorType source;
-        Predicate predicate;
-        bool skipping = true;
+    // infinite streams report SIZE_MAX as their lower bound, so bounds are added with saturation
+    inline CONSTEXPR size_t saturatingAdd(size_t lhs, size_t rhs) {
+        return lhs > std::numeric_limits<size_t>::max() - rhs ? std::numeric_limits<size_t>::max() : lhs + rhs;
+    }
 
-        auto get_impl() {
-            return source.get();
+    // Bounds on the number of elements left in a stream, `upper` is nullopt when unknown or infinite
+    struct SizeHint {
+        size_t lower;
+        Optional<size_t> upper;
+
+        static SizeHint exactly(size_t size) {
+            return{ size, size };
         }
 
-        bool advance_impl() {
-            if (skipping) {
-                while (skipping && source.advance()) {
-                    skipping = predicate(*source.get());
-                }
-                return !skipping; // depleted stream : skipping == true
-            } else {
-                return source.advance();
-            }
+        static SizeHint unknown() {
+            return{ 0, nullopt };
         }
 
-    };
+        bool exact() const {
+            return upper && *upper == lower;
+        }
 
-    template<typename ExtractorType>
-    struct TakeStreamExtractor : StreamExtractor<TakeStreamExtractor<ExtractorType>> {
-        TakeStreamExtractor(ExtractorType extractor, size_t count) : source(extractor), limit(count) {}
+        // the same stream with any number of elements dropped
+        SizeHint filtered() const {
+            return{ 0, upper };
+        }
 
-        ExtractorType source;
-        size_t limit;
+        SizeHint skip(size_t count) const {
+            return{ lower > count ? lower - count : 0, upper ? Optional<size_t>(*upper > count ? *upper - count : 0) : nullopt };
+        }
 
-        auto get_impl() {
-            return source.get();
+        SizeHint take(size_t count) const {
+            return{ std::min(lower, count), upper ? std::min(*upper, count) : count };
         }
 
-        bool advance_impl() {
-            if (limit != 0) {
-                --limit;
-                return source.advance();
+        SizeHint operator + (const SizeHint& other) const {
+            if (upper && other.upper && *upper <= std::numeric_limits<size_t>::max() - *other.upper) {
+                return{ saturatingAdd(lower, other.lower), *upper + *other.upper };
             }
-            return false;
+            return{ saturatingAdd(lower, other.lower), nullopt };
         }
 
+        static SizeHint min(const SizeHint& lhs, const SizeHint& rhs) {
+            if (lhs.upper && rhs.upper) {
+                return{ std::min(lhs.lower, rhs.lower), std::min(*lhs.upper, *rhs.upper) };
+            }
+            return{ std::min(lhs.lower, rhs.lower), lhs.upper ? lhs.upper : rhs.upper };
+        }
     };
 
-    template<typename ExtractorType, typename Predicate>
-    struct TakeWhileStreamExtractor : StreamExtractor<TakeWhileStreamExtractor<ExtractorType, Predicate>> {
-        TakeWhileStreamExtractor(ExtractorType extractor, Predicate&& predicate) : source(extractor), predicate(std::forward<Predicate>(predicate)) {}
+    // Capabilities are static members that derived extractors shadow:
+    //  - splittable: split(from, to) returns a copy restricted to the source positions [from, to),
+    //    and splitSize() is the number of source positions left;
+    //  - oneToOne: every source position yields exactly one element;
+    //  - randomAccess: advanceBy(n) takes constant time;
+    //  - contiguous: a SequenceStreamExtractor whose elements lie in one array;
+    //  - blockwise: forEachBlock(sink) consumes the stream calling sink(const T* data, size_t size) on
+    //    non-empty arrays of arithmetic elements, which lets terminal operations use simd:: kernels.
+    //    Each stage runs its callable over up to simd::BlockSize elements before the next stage sees
+    //    them, so count(), fold() with std::plus and min()/max() with default comparators, the only
+    //    terminal operations taking this path, need side-effect free filters and transforms.
+    //
+    // Besides pulling with advance()/get(), elements can be pushed: forEachWhile(sink) feeds elements
+    // to `sink` until it returns false. It returns false if the sink stopped it and true when the stream
+    // is depleted, so the stream stays usable after an early stop.
+    template <typename DerivedStreamExtractor>
+    struct StreamExtractor {
+        static constexpr bool splittable = false;
+        static constexpr bool oneToOne = false;
+        static constexpr bool blockwise = false;
+        static constexpr bool randomAccess = false;
+        static constexpr bool contiguous = false;
 
-        ExtractorType source;
-        Predicate predicate;
-        bool taking = true;
+        CONSTEXPR auto get() noexcept(noexcept(std::declval<DerivedStreamExtractor>().get_impl())) {
+            return static_cast<DerivedStreamExtractor*>(this)->get_impl();
+        }
 
-        auto get_impl() {
-            return source.get();
+        CONSTEXPR bool advance() noexcept(noexcept(std::declval<DerivedStreamExtractor>().advance_impl())) {
+            return static_cast<DerivedStreamExtractor*>(this)->advance_impl();
         }
 
-        bool advance_impl() {
-            taking &= taking && source.advance() && predicate(*source.get());
-            return taking;
+        SizeHint sizeHint() const {
+            return static_cast<const DerivedStreamExtractor*>(this)->sizeHint_impl();
         }
 
-    };
+        SizeHint sizeHint_impl() const {
+            return SizeHint::unknown();
+        }
 
+        template<typename Sink>
+        bool forEachWhile(Sink&& sink) {
+            return static_cast<DerivedStreamExtractor*>(this)->forEachWhile_impl(sink);
+        }
 
-    template<typename ExtractorType, typename Predicate>
-    struct FilterStreamExtractor : StreamExtractor<FilterStreamExtractor<ExtractorType, Predicate>> {
-        FilterStreamExtractor(ExtractorType extractor, Predicate&& p) : source(extractor), predicate(std::forward<Predicate>(p)) {}
+        // skips up to `count` elements without yielding them, returns how many were skipped:
+        // fewer than `count` only when the stream is depleted
+        CONSTEXPR size_t advanceBy(size_t count) {
+            return static_cast<DerivedStreamExtractor*>(this)->advanceBy_impl(count);
+        }
 
-        ExtractorType source;
-        Predicate predicate;
+        CONSTEXPR size_t advanceBy_impl(size_t count) {
+            size_t skipped = 0;
+            while (skipped != count && static_cast<DerivedStreamExtractor*>(this)->advance_impl()) {
+                ++skipped;
+            }
+            return skipped;
+        }
 
-        auto get_impl() {
-            return source.get();
+        // block-wise extractors only, consumes the stream
+        size_t countBlocks() {
+            size_t count = 0;
+            static_cast<DerivedStreamExtractor*>(this)->forEachBlock([&count](const auto*, size_t size) {
+                count += size;
+            });
+            return count;
         }
 
-        bool advance_impl() {
-            if (!source.advance()) {
-                return false;
-            }
-            auto elementPtr = source.get();
-            while (!predicate(*elementPtr)) {
-                if (source.advance()) {
-                    elementPtr = source.get();
-                } else {
+        // pull-based fallback for extractors without a dedicated loop
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            auto self = static_cast<DerivedStreamExtractor*>(this);
+            while (self->advance_impl()) {
+                if (!sink(*self->get_impl())) {
                     return false;
                 }
             }
             return true;
         }
-
     };
 
+    // Keeps the callable of an adaptor. Empty callables (e.g. lambdas without captures) are stored as a
+    // base class, so they take no space in the extractor. Index tells apart several callables of one extractor.
+    template<typename Functor, size_t Index = 0, bool = std::is_empty<Functor>::value && !std::is_final<Functor>::value>
+    struct FunctorStorage {
+        CONSTEXPR FunctorStorage(Functor&& f) : f(std::forward<Functor>(f)) {}
 
-    template<typename ExtractorType, typename Transform>
-    struct FilterMapStreamExtractor : StreamExtractor<FilterMapStreamExtractor<ExtractorType, Transform>> {
-        FilterMapStreamExtractor(ExtractorType extractor, Transform&& t) : source(extractor), transform(std::forward<Transform>(t)) {}
+        Functor f;
 
-        ExtractorType source;
-        Transform transform;
+        CONSTEXPR Functor& functor() {
+            return f;
+        }
 
-        traits::ValueType<ExtractorType> storage {};
+        CONSTEXPR const Functor& functor() const {
+            return f;
+        }
+    };
 
-        static_assert(traits::IsOptional<decltype(std::declval<Transform>()(*source.get()))>(), "Transform functor should return Optional<T> type");
+    template<typename Functor, size_t Index>
+    struct FunctorStorage<Functor, Index, true> : Functor {
+        CONSTEXPR FunctorStorage(Functor&& f) : Functor(std::forward<Functor>(f)) {}
 
-        auto get_impl() {
-            return &storage;
+        CONSTEXPR Functor& functor() {
+            return *this;
         }
 
-        bool advance_impl() {
-            while (true) {
-                if (!source.advance()) {
-                    return false;
-                }
-                auto e = transform(*source.get());
-                if (e) {
-                    storage = *e;
-                    return true;
-                }
-            }
+        CONSTEXPR const Functor& functor() const {
+            return *this;
         }
-
     };
 
 
-    template<typename ExtractorType, typename Transform>
-    struct MapStreamExtractor : StreamExtractor<MapStreamExtractor<ExtractorType, Transform>> {
-        MapStreamExtractor(ExtractorType sourceExtractor, Transform&& transform) : source(sourceExtractor), transformer(std::forward<Transform>(transform)) {}
+    // A cursor over [current, end): once an element has been yielded `current` points to it, and the
+    // next advance() steps past it.
+    template <typename IteratorType>
+    struct SequenceStreamExtractor : StreamExtractor<SequenceStreamExtractor<IteratorType>> {
+        CONSTEXPR SequenceStreamExtractor(IteratorType&& b, IteratorType&& e)
+            : current(std::forward<IteratorType>(b)), end(std::forward<IteratorType>(e)) {}
 
-        ExtractorType source;
-        Transform transformer;
+        IteratorType current;
+        IteratorType end;
+        bool started = false;
 
-        traits::ApplyOnValueType<ExtractorType, Transform> value {};
+        static constexpr bool splittable = traits::IsRandomAccess<IteratorType>::value;
+        static constexpr bool oneToOne = true;
+        static constexpr bool randomAccess = traits::IsRandomAccess<IteratorType>::value;
+        static constexpr bool contiguous = traits::IsContiguous<IteratorType>::value;
+        static constexpr bool blockwise = traits::IsContiguous<IteratorType>::value
+                                       && traits::IsBlockwise<typename std::iterator_traits<IteratorType>::value_type>::value;
 
-        auto get_impl() {
-            value = transformer(*source.get());
-            return &value;
+        CONSTEXPR auto get_impl() noexcept {
+            return current;
         }
 
-        bool advance_impl() {
-            return source.advance();
+        // the first element not yielded yet
+        IteratorType rest() const {
+            return started && current != end ? std::next(current) : current;
         }
 
-    };
+        size_t splitSize() const {
+            return static_cast<size_t>(end - rest());
+        }
 
+        SizeHint sizeHint_impl() const {
+            return sizeHint_impl(traits::IsRandomAccess<IteratorType>{});
+        }
 
-    template<typename ExtractorType, typename Transform>
-    struct FlatMapStreamExtractor : StreamExtractor<FlatMapStreamExtractor<ExtractorType, Transform>> {
-        FlatMapStreamExtractor(ExtractorType sourceExtractor, Transform&& transform) : source(sourceExtractor), transformer(std::forward<Transform>(transform)) {}
+        SizeHint sizeHint_impl(std::true_type) const {
+            return SizeHint::exactly(splitSize());
+        }
 
-        ExtractorType source;
-        Transform transformer;
+        SizeHint sizeHint_impl(std::false_type) const {
+            return rest() == end ? SizeHint::exactly(0) : SizeHint::unknown();
+        }
 
-        traits::ApplyOnValueType<ExtractorType, Transform> innerCollection{};
+        SequenceStreamExtractor split(size_t from, size_t to) const {
+            using Difference = typename std::iterator_traits<IteratorType>::difference_type;
+            const IteratorType first = rest();
+            return SequenceStreamExtractor(first + static_cast<Difference>(from), first + static_cast<Difference>(to));
+        }
 
-        using SequenceStreamExtractorType = SequenceStreamExtractor<decltype(std::begin(innerCollection))>;
-        SequenceStreamExtractorType sequence{ std::begin(innerCollection), std::end(innerCollection) };
+        CONSTEXPR bool advance_impl() {
+            skipYielded();
+            return current != end;
+        }
 
+        CONSTEXPR size_t advanceBy_impl(size_t count) {
+            return advanceBy_impl(count, traits::IsRandomAccess<IteratorType>{});
+        }
 
-        auto get_impl() {
-            return sequence.get();
+        CONSTEXPR size_t advanceBy_impl(size_t count, std::true_type) {
+            using Difference = typename std::iterator_traits<IteratorType>::difference_type;
+            if (started && current != end) {
+                ++current;
+            }
+            const size_t skipped = std::min(count, static_cast<size_t>(end - current));
+            current += static_cast<Difference>(skipped);
+            started = false;
+            return skipped;
         }
 
-        bool advance_impl() {
-            if (!sequence.advance()) {
-                if (source.advance()) {
-                    innerCollection = transformer(*source.get());
-                    sequence.~SequenceStreamExtractorType();
-                    new(&sequence) SequenceStreamExtractor<decltype(std::begin(innerCollection))> { std::begin(innerCollection), std::end(innerCollection) };
-                    return advance_impl();
-                }
-                else {
+        CONSTEXPR size_t advanceBy_impl(size_t count, std::false_type) {
+            return StreamExtractor<SequenceStreamExtractor<IteratorType>>::advanceBy_impl(count);
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            for (skipYielded(); current != end; ++current) {
+                if (!sink(*current)) {
                     return false;
                 }
             }
-            else {
-                return true;
+            return true;
+        }
+
+        template<typename BlockSink>
+        void forEachBlock(BlockSink&& sink) {
+            skipYielded();
+            if (current != end) {
+                sink(&*current, static_cast<size_t>(end - current));
+                current = end;
             }
         }
 
+    private:
+        CONSTEXPR void skipYielded() {
+            if (started && current != end) {
+                ++current;
+            }
+            started = true;
+        }
     };
 
-
-    template<typename ExtractorType, typename Inspector>
-    struct InspectStreamExtractor : StreamExtractor<InspectStreamExtractor<ExtractorType, Inspector>> {
-        InspectStreamExtractor(ExtractorType extractor, Inspector&& inspector) : source(extractor), inspector(std::forward<Inspector>(inspector)) {}
+    template<typename ExtractorType>
+    struct SkipFirstStreamExtractor : StreamExtractor<SkipFirstStreamExtractor<ExtractorType>> {
+        CONSTEXPR SkipFirstStreamExtractor(ExtractorType extractor, size_t count) : source(extractor), skipCount(count) {}
 
         ExtractorType source;
-        Inspector inspector;
+        size_t skipCount;
 
-        auto get_impl() {
+        static constexpr bool randomAccess = ExtractorType::randomAccess;
+
+        CONSTEXPR auto get_impl() {
             return source.get();
         }
 
-        bool advance_impl() {
-            if (source.advance()) {
-                inspector(*source.get());
-                return true;
-            }
-            return false;
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint().skip(skipCount);
         }
 
-    };
-
-
-    template<typename ExtractorType, typename Inspector>
-    struct SpyStreamExtractor : StreamExtractor<SpyStreamExtractor<ExtractorType, Inspector>> {
-        SpyStreamExtractor(ExtractorType extractor, Inspector&& inspector) : source(extractor), inspector(std::forward<Inspector>(inspector)) {}
+        CONSTEXPR bool advance_impl() {
+            return skipPending() && source.advance();
+        }
 
-        ExtractorType source;
-        Inspector inspector;
+        CONSTEXPR size_t advanceBy_impl(size_t count) {
+            const size_t pending = skipCount;
+            skipCount = 0;
+            const size_t skipped = source.advanceBy(saturatingAdd(pending, count));
+            return skipped > pending ? skipped - pending : 0;
+        }
 
-        auto get_impl() {
-            auto value = source.get();
-            inspector(*value);
-            return value;
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            return !skipPending() || source.forEachWhile(sink);
         }
 
-        bool advance_impl() {
-            return source.advance();
+    private:
+        // false if the source is depleted
+        CONSTEXPR bool skipPending() {
+            const size_t pending = skipCount;
+            skipCount = 0;
+            return pending == 0 || source.advanceBy(pending) == pending;
         }
 
     };
 
+    template<typename ExtractorType, typename Predicate>
+    struct SkipWhileStreamExtractor : StreamExtractor<SkipWhileStreamExtractor<ExtractorType, Predicate>>, FunctorStorage<Predicate> {
+        CONSTEXPR SkipWhileStreamExtractor(ExtractorType extractor, Predicate&& predicate) : FunctorStorage<Predicate>(std::forward<Predicate>(predicate)), source(extractor) {}
 
-    template<typename T>
-    struct Enumerated {
-        size_t i;
-        std::decay_t<T> v;
-        Enumerated& operator = (const Enumerated&) = default;
-    };
+        ExtractorType source;
+        bool skipping = true;
 
-    template<typename T>
-    bool operator == (const Enumerated<T>& lhs, const Enumerated<T>& rhs) {
-        return lhs.i == rhs.i && lhs.v == rhs.v;
-    }
+        CONSTEXPR auto get_impl() {
+            return source.get();
+        }
+
+        SizeHint sizeHint_impl() const {
+            return skipping ? source.sizeHint().filtered() : source.sizeHint();
+        }
+
+        CONSTEXPR bool advance_impl() {
+            if (skipping) {
+                while (skipping && source.advance()) {
+                    skipping = this->functor()(*source.get());
+                }
+                return !skipping; // depleted stream : skipping == true
+            } else {
+                return source.advance();
+            }
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            while (skipping) {
+                if (!source.advance()) {
+                    return true;
+                }
+                skipping = this->functor()(*source.get());
+                if (!skipping && !sink(*source.get())) {
+                    return false;
+                }
+            }
+            return source.forEachWhile(sink);
+        }
 
+    };
 
     template<typename ExtractorType>
-    struct EnumerateStreamExtractor : StreamExtractor<EnumerateStreamExtractor<ExtractorType>> {
-        EnumerateStreamExtractor(ExtractorType extractor, size_t counter = 0) : source(extractor), counter(counter){}
+    struct TakeStreamExtractor : StreamExtractor<TakeStreamExtractor<ExtractorType>> {
+        CONSTEXPR TakeStreamExtractor(ExtractorType extractor, size_t count) : source(extractor), limit(count) {}
 
         ExtractorType source;
-        size_t counter;
-        Enumerated<traits::ValueType<ExtractorType>> value {counter, {}};
+        size_t limit;
 
-        auto get_impl() {
-            value = {counter - 1, *source.get()};
-            return &value;
+        static constexpr bool randomAccess = ExtractorType::randomAccess;
+
+        CONSTEXPR auto get_impl() {
+            return source.get();
         }
 
-        bool advance_impl() {
-            ++counter;
-            return source.advance();
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint().take(limit);
+        }
+
+        CONSTEXPR bool advance_impl() {
+            if (limit != 0) {
+                --limit;
+                return source.advance();
+            }
+            return false;
+        }
+
+        CONSTEXPR size_t advanceBy_impl(size_t count) {
+            const size_t skipped = source.advanceBy(std::min(count, limit));
+            limit -= skipped;
+            return skipped;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            if (limit == 0) {
+                return true;
+            }
+            bool stopped = false;
+            source.forEachWhile([this, &sink, &stopped](auto&& e) {
+                --limit;
+                if (!sink(std::forward<decltype(e)>(e))) {
+                    stopped = true;
+                    return false;
+                }
+                return limit != 0;
+            });
+            return !stopped;
         }
 
     };
 
+    // skip(n).take(m) as a single stage
+    template<typename ExtractorType>
+    struct SliceStreamExtractor : StreamExtractor<SliceStreamExtractor<ExtractorType>> {
+        CONSTEXPR SliceStreamExtractor(ExtractorType extractor, size_t skip, size_t count) : source(extractor), skipCount(skip), limit(count) {}
+
+        ExtractorType source;
+        size_t skipCount;
+        size_t limit;
+
+        static constexpr bool randomAccess = ExtractorType::randomAccess;
+
+        CONSTEXPR auto get_impl() {
+            return source.get();
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint().skip(skipCount).take(limit);
+        }
+
+        CONSTEXPR bool advance_impl() {
+            if (limit == 0) {
+                return false;
+            }
+            --limit;
+            return skipPending() && source.advance();
+        }
+
+        CONSTEXPR size_t advanceBy_impl(size_t count) {
+            const size_t pending = skipCount;
+            skipCount = 0;
+            const size_t skipped = source.advanceBy(saturatingAdd(pending, std::min(count, limit)));
+            const size_t taken = skipped > pending ? skipped - pending : 0;
+            limit -= taken;
+            return taken;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            if (limit == 0 || !skipPending()) {
+                return true;
+            }
+            bool stopped = false;
+            source.forEachWhile([this, &sink, &stopped](auto&& e) {
+                --limit;
+                if (!sink(std::forward<decltype(e)>(e))) {
+                    stopped = true;
+                    return false;
+                }
+                return limit != 0;
+            });
+            return !stopped;
+        }
 
+    private:
+        // false if the source is depleted
+        CONSTEXPR bool skipPending() {
+            const size_t pending = skipCount;
+            skipCount = 0;
+            return pending == 0 || source.advanceBy(pending) == pending;
+        }
+    };
+
+    // The first element and then every `step`-th one
     template<typename ExtractorType>
-    struct EnumerateTupleStreamExtractor : StreamExtractor<EnumerateTupleStreamExtractor<ExtractorType>> {
-        EnumerateTupleStreamExtractor(ExtractorType extractor, size_t counter = 0) : source(extractor), counter(counter) {}
+    struct StepByStreamExtractor : StreamExtractor<StepByStreamExtractor<ExtractorType>> {
+        CONSTEXPR StepByStreamExtractor(ExtractorType extractor, size_t step) : source(extractor), step(step) {}
 
         ExtractorType source;
-        size_t counter;
-        std::tuple<size_t, traits::ValueType<ExtractorType>> value {counter, {}};
+        size_t step;
+        bool first = true;
 
-        auto get_impl() {
-            value = std::make_tuple(counter - 1, *source.get());
-            return &value;
+        static constexpr bool randomAccess = ExtractorType::randomAccess;
+
+        CONSTEXPR auto get_impl() {
+            return source.get();
         }
 
-        bool advance_impl() {
-            ++counter;
+        SizeHint sizeHint_impl() const {
+            const SizeHint hint = source.sizeHint();
+            return{ stepped(hint.lower), hint.upper ? Optional<size_t>(stepped(*hint.upper)) : nullopt };
+        }
+
+        CONSTEXPR bool advance_impl() {
+            if (!first && source.advanceBy(step - 1) != step - 1) {
+                return false;
+            }
+            first = false;
             return source.advance();
         }
 
+        // element k is `k * step` positions past the first one left
+        CONSTEXPR size_t advanceBy_impl(size_t count) {
+            if (count == 0) {
+                return 0;
+            }
+            const size_t offset = first ? 0 : step - 1;
+            const size_t positions = count > (std::numeric_limits<size_t>::max() - offset) / step ? std::numeric_limits<size_t>::max() : offset + count * step;
+            const size_t skipped = source.advanceBy(positions);
+            const size_t advanced = skipped == positions ? count : stepped(skipped);
+            first = true;
+            return advanced;
+        }
+
+    private:
+        // number of elements among `positions` source positions
+        CONSTEXPR size_t stepped(size_t positions) const {
+            if (first) {
+                return positions / step + (positions % step != 0);
+            }
+            return positions / step;
+        }
     };
 
+    template<typename ExtractorType, typename Predicate>
+    struct TakeWhileStreamExtractor : StreamExtractor<TakeWhileStreamExtractor<ExtractorType, Predicate>>, FunctorStorage<Predicate> {
+        CONSTEXPR TakeWhileStreamExtractor(ExtractorType extractor, Predicate&& predicate) : FunctorStorage<Predicate>(std::forward<Predicate>(predicate)), source(extractor) {}
 
-    template<typename ExtractorType, typename ExtractorOtherType>
-    struct ChainStreamExtractor : StreamExtractor<ChainStreamExtractor<ExtractorType, ExtractorOtherType>> {
-        ChainStreamExtractor(ExtractorType extractor, ExtractorOtherType other) : first(extractor), next(other){}
+        ExtractorType source;
+        bool taking = true;
 
-        ExtractorType first;
-        ExtractorOtherType next;
-        bool firstHaveElements = true;
+        CONSTEXPR auto get_impl() {
+            return source.get();
+        }
 
-        auto get_impl() {
-            if (firstHaveElements) {
-                return first.get();
-            } else {
-                return next.get();
+        SizeHint sizeHint_impl() const {
+            return taking ? source.sizeHint().filtered() : SizeHint::exactly(0);
+        }
+
+        CONSTEXPR bool advance_impl() {
+            taking &= taking && source.advance() && this->functor()(*source.get());
+            return taking;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            if (!taking) {
+                return true;
+            }
+            bool stopped = false;
+            source.forEachWhile([this, &sink, &stopped](auto&& e) {
+                if (!this->functor()(e)) {
+                    return false;
+                }
+                stopped = !sink(std::forward<decltype(e)>(e));
+                return !stopped;
+            });
+            taking = stopped;
+            return !stopped;
+        }
+
+    };
+
+
+    template<typename ExtractorType, typename Predicate>
+    struct FilterStreamExtractor : StreamExtractor<FilterStreamExtractor<ExtractorType, Predicate>>, FunctorStorage<Predicate> {
+        CONSTEXPR FilterStreamExtractor(ExtractorType extractor, Predicate&& p) : FunctorStorage<Predicate>(std::forward<Predicate>(p)), source(extractor) {}
+
+        ExtractorType source;
+
+        static constexpr bool splittable = ExtractorType::splittable;
+        static constexpr bool blockwise = ExtractorType::blockwise;
+
+        CONSTEXPR auto get_impl() {
+            return source.get();
+        }
+
+        template<typename BlockSink>
+        void forEachBlock(BlockSink&& sink) {
+            source.forEachBlock([this, &sink](const auto* data, size_t size) {
+                std::remove_const_t<std::remove_reference_t<decltype(*data)>> buffer[simd::BlockSize];
+                for (size_t offset = 0; offset < size; offset += simd::BlockSize) {
+                    const size_t kept = simd::compact(data + offset, std::min(simd::BlockSize, size - offset), buffer, this->functor());
+                    if (kept != 0) {
+                        sink(buffer, kept);
+                    }
+                }
+            });
+        }
+
+        size_t countBlocks() {
+            size_t count = 0;
+            source.forEachBlock([this, &count](const auto* data, size_t size) {
+                count += simd::countIf(data, size, this->functor());
+            });
+            return count;
+        }
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        FilterStreamExtractor split(size_t from, size_t to) const {
+            return FilterStreamExtractor(source.split(from, to), Predicate(this->functor()));
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint().filtered();
+        }
+
+        CONSTEXPR bool advance_impl() {
+            if (!source.advance()) {
+                return false;
+            }
+            auto elementPtr = source.get();
+            while (!this->functor()(*elementPtr)) {
+                if (source.advance()) {
+                    elementPtr = source.get();
+                } else {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            return source.forEachWhile([this, &sink](auto&& e) {
+                return !this->functor()(e) || sink(std::forward<decltype(e)>(e));
+            });
+        }
+
+    };
+
+
+    template<typename ExtractorType, typename Transform>
+    struct FilterMapStreamExtractor : StreamExtractor<FilterMapStreamExtractor<ExtractorType, Transform>>, FunctorStorage<Transform> {
+        CONSTEXPR FilterMapStreamExtractor(ExtractorType extractor, Transform&& t) : FunctorStorage<Transform>(std::forward<Transform>(t)), source(extractor) {}
+
+        ExtractorType source;
+
+        traits::ValueType<ExtractorType> storage {};
+
+        static_assert(traits::IsOptional<decltype(std::declval<Transform>()(*source.get()))>(), "Transform functor should return Optional<T> type");
+
+        static constexpr bool splittable = ExtractorType::splittable;
+
+        CONSTEXPR auto get_impl() {
+            return &storage;
+        }
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        FilterMapStreamExtractor split(size_t from, size_t to) const {
+            return FilterMapStreamExtractor(source.split(from, to), Transform(this->functor()));
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint().filtered();
+        }
+
+        CONSTEXPR bool advance_impl() {
+            while (true) {
+                if (!source.advance()) {
+                    return false;
+                }
+                auto e = this->functor()(*source.get());
+                if (e) {
+                    storage = *e;
+                    return true;
+                }
+            }
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            return source.forEachWhile([this, &sink](auto&& e) {
+                auto transformed = this->functor()(e);
+                return !transformed || sink(*std::move(transformed));
+            });
+        }
+
+    };
+
+
+    // An element built in place and kept until the next one is built. Trivially copyable types are kept
+    // in a union, which unlike Optional can be rebuilt in a constant expression.
+    template<typename T, bool = std::is_trivially_copy_constructible<T>::value && std::is_trivially_copy_assignable<T>::value
+                                && std::is_trivially_destructible<T>::value>
+    struct ValueCache {
+        Optional<T> value {};
+
+        template<typename... Args>
+        void emplace(Args&&... args) {
+            value.emplace(std::forward<Args>(args)...);
+        }
+
+        T& get() {
+            return *value;
+        }
+    };
+
+    template<typename T>
+    struct ValueCache<T, true> {
+        union Storage {
+            char empty;
+            T value;
+
+            CONSTEXPR Storage() : empty() {}
+
+            template<typename... Args>
+            CONSTEXPR Storage(int, Args&&... args) : value(std::forward<Args>(args)...) {}
+        } storage {};
+
+        template<typename... Args>
+        CONSTEXPR void emplace(Args&&... args) {
+            storage = Storage(0, std::forward<Args>(args)...);
+        }
+
+        CONSTEXPR T& get() {
+            return storage.value;
+        }
+    };
+
+
+    template<typename ExtractorType, typename Transform>
+    struct MapStreamExtractor : StreamExtractor<MapStreamExtractor<ExtractorType, Transform>>, FunctorStorage<Transform> {
+        CONSTEXPR MapStreamExtractor(ExtractorType sourceExtractor, Transform&& transform) : FunctorStorage<Transform>(std::forward<Transform>(transform)), source(sourceExtractor) {}
+
+        // the cached element is never copied, a copy evaluates its current element again if asked
+        CONSTEXPR MapStreamExtractor(const MapStreamExtractor& other) : FunctorStorage<Transform>(other), source(other.source) {}
+
+        ExtractorType source;
+
+        using value_type = std::decay_t<traits::ApplyOnValueType<ExtractorType, Transform>>;
+
+        // the transformed element is built in place on the first get() after advance() and kept until
+        // the next one, so the result type needs neither a default constructor nor copy assignment
+        ValueCache<value_type> value {};
+        bool evaluated = false;
+
+        static constexpr bool splittable = ExtractorType::splittable;
+        static constexpr bool oneToOne = ExtractorType::oneToOne;
+        static constexpr bool blockwise = ExtractorType::blockwise && traits::IsBlockwise<value_type>::value;
+        static constexpr bool randomAccess = ExtractorType::randomAccess;
+
+        template<typename BlockSink>
+        void forEachBlock(BlockSink&& sink) {
+            evaluated = false;
+            source.forEachBlock([this, &sink](const auto* data, size_t size) {
+                value_type buffer[simd::BlockSize];
+                for (size_t offset = 0; offset < size; offset += simd::BlockSize) {
+                    const size_t count = std::min(simd::BlockSize, size - offset);
+                    for (size_t i = 0; i < count; ++i) {
+                        buffer[i] = this->functor()(data[offset + i]);
+                    }
+                    sink(buffer, count);
+                }
+            });
+        }
+
+        CONSTEXPR auto get_impl() {
+            if (!evaluated) {
+                value.emplace(this->functor()(*source.get()));
+                evaluated = true;
             }
+            return &value.get();
+        }
+
+        // counting doesn't need the transformed elements
+        size_t countBlocks() {
+            evaluated = false;
+            return source.countBlocks();
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            evaluated = false;
+            return source.forEachWhile([this, &sink](auto&& e) {
+                return sink(this->functor()(e));
+            });
+        }
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        MapStreamExtractor split(size_t from, size_t to) const {
+            return MapStreamExtractor(source.split(from, to), Transform(this->functor()));
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint();
+        }
+
+        CONSTEXPR bool advance_impl() {
+            evaluated = false;
+            return source.advance();
+        }
+
+        CONSTEXPR size_t advanceBy_impl(size_t count) {
+            evaluated = false;
+            return source.advanceBy(count);
+        }
+
+    };
+
+
+    // map(f).map(g) as map(g . f). The intermediate value is kept as an lvalue, as map() passes it
+    template<typename First, typename Second>
+    struct ComposedTransform : FunctorStorage<First, 0>, FunctorStorage<Second, 1> {
+        CONSTEXPR ComposedTransform(First&& first, Second&& second)
+            : FunctorStorage<First, 0>(std::forward<First>(first)), FunctorStorage<Second, 1>(std::forward<Second>(second)) {}
+
+        template<typename T>
+        CONSTEXPR auto operator()(T& e) {
+            auto intermediate = FunctorStorage<First, 0>::functor()(e);
+            return FunctorStorage<Second, 1>::functor()(intermediate);
+        }
+    };
+
+
+    // filter(p).map(f) as a single stage
+    template<typename ExtractorType, typename Predicate, typename Transform>
+    struct FilteredMapStreamExtractor : StreamExtractor<FilteredMapStreamExtractor<ExtractorType, Predicate, Transform>>
+                                      , FunctorStorage<Predicate, 0>, FunctorStorage<Transform, 1> {
+        CONSTEXPR FilteredMapStreamExtractor(ExtractorType extractor, Predicate&& p, Transform&& t)
+            : FunctorStorage<Predicate, 0>(std::forward<Predicate>(p)), FunctorStorage<Transform, 1>(std::forward<Transform>(t)), source(extractor) {}
+
+        // like in MapStreamExtractor the cached element is never copied
+        CONSTEXPR FilteredMapStreamExtractor(const FilteredMapStreamExtractor& other)
+            : FunctorStorage<Predicate, 0>(other), FunctorStorage<Transform, 1>(other), source(other.source) {}
+
+        ExtractorType source;
+
+        using value_type = std::decay_t<traits::ApplyOnValueType<ExtractorType, Transform>>;
+
+        ValueCache<value_type> value {};
+        bool evaluated = false;
+
+        static constexpr bool splittable = ExtractorType::splittable;
+        static constexpr bool blockwise = ExtractorType::blockwise && traits::IsBlockwise<value_type>::value;
+
+        CONSTEXPR Predicate& predicate() {
+            return FunctorStorage<Predicate, 0>::functor();
+        }
+
+        CONSTEXPR const Predicate& predicate() const {
+            return FunctorStorage<Predicate, 0>::functor();
+        }
+
+        CONSTEXPR Transform& transform() {
+            return FunctorStorage<Transform, 1>::functor();
+        }
+
+        CONSTEXPR const Transform& transform() const {
+            return FunctorStorage<Transform, 1>::functor();
+        }
+
+        template<typename BlockSink>
+        void forEachBlock(BlockSink&& sink) {
+            evaluated = false;
+            source.forEachBlock([this, &sink](const auto* data, size_t size) {
+                std::remove_const_t<std::remove_reference_t<decltype(*data)>> kept[simd::BlockSize];
+                value_type buffer[simd::BlockSize];
+                for (size_t offset = 0; offset < size; offset += simd::BlockSize) {
+                    const size_t count = simd::compact(data + offset, std::min(simd::BlockSize, size - offset), kept, predicate());
+                    const auto* filtered = kept;
+                    for (size_t i = 0; i < count; ++i) {
+                        buffer[i] = transform()(filtered[i]);
+                    }
+                    if (count != 0) {
+                        sink(buffer, count);
+                    }
+                }
+            });
+        }
+
+        // counting needs the predicate only
+        size_t countBlocks() {
+            evaluated = false;
+            size_t count = 0;
+            source.forEachBlock([this, &count](const auto* data, size_t size) {
+                count += simd::countIf(data, size, predicate());
+            });
+            return count;
+        }
+
+        CONSTEXPR auto get_impl() {
+            if (!evaluated) {
+                value.emplace(transform()(*source.get()));
+                evaluated = true;
+            }
+            return &value.get();
+        }
+
+        CONSTEXPR bool advance_impl() {
+            evaluated = false;
+            while (source.advance()) {
+                if (predicate()(*source.get())) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            evaluated = false;
+            return source.forEachWhile([this, &sink](auto&& e) {
+                return !predicate()(e) || sink(transform()(e));
+            });
+        }
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        FilteredMapStreamExtractor split(size_t from, size_t to) const {
+            return FilteredMapStreamExtractor(source.split(from, to), Predicate(predicate()), Transform(transform()));
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint().filtered();
+        }
+
+    };
+
+
+    // Iterates over a collection it owns. Copies and moves keep the position, the iterators
+    // are rebuilt over the new collection.
+    template<typename Container>
+    struct OwningSequenceStreamExtractor : StreamExtractor<OwningSequenceStreamExtractor<Container>> {
+        using SequenceType = SequenceStreamExtractor<decltype(std::cbegin(std::declval<const Container&>()))>;
+
+        OwningSequenceStreamExtractor(Container&& c) : collection(std::move(c)), sequence(std::cbegin(collection), std::cend(collection)) {}
+        OwningSequenceStreamExtractor(const OwningSequenceStreamExtractor& other) : OwningSequenceStreamExtractor(Container(other.collection), other.position()) {}
+        OwningSequenceStreamExtractor(OwningSequenceStreamExtractor&& other) : OwningSequenceStreamExtractor(std::move(other.collection), other.position()) {}
+
+        Container collection;
+        SequenceType sequence;
+
+        static constexpr bool randomAccess = SequenceType::randomAccess;
+
+        auto get_impl() noexcept {
+            return sequence.get();
+        }
+
+        bool advance_impl() {
+            return sequence.advance();
+        }
+
+        size_t advanceBy_impl(size_t count) {
+            return sequence.advanceBy(count);
+        }
+
+        SizeHint sizeHint_impl() const {
+            return sequence.sizeHint();
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            return sequence.forEachWhile(sink);
+        }
+
+    private:
+        using Position = std::pair<ptrdiff_t, bool>;
+
+        Position position() const {
+            return{ std::distance(std::cbegin(collection), sequence.current), sequence.started };
+        }
+
+        OwningSequenceStreamExtractor(Container&& c, Position position) : OwningSequenceStreamExtractor(std::move(c)) {
+            sequence.current = std::next(std::cbegin(collection), position.first);
+            sequence.started = position.second;
+        }
+    };
+
+
+    // Iterates over a collection shared by all copies of the stream, so iterators stay valid
+    // whichever copy outlives the others. It is a SequenceStreamExtractor in every other respect.
+    template<typename Container>
+    struct SharedSequenceStreamExtractor : SequenceStreamExtractor<decltype(std::cbegin(std::declval<const Container&>()))> {
+        using SequenceType = SequenceStreamExtractor<decltype(std::cbegin(std::declval<const Container&>()))>;
+
+        SharedSequenceStreamExtractor(std::shared_ptr<const Container> c)
+            : SequenceType(std::cbegin(*c), std::cend(*c))
+            , collection(std::move(c)) {}
+
+        SharedSequenceStreamExtractor(std::shared_ptr<const Container> c, SequenceType part)
+            : SequenceType(std::move(part)), collection(std::move(c)) {}
+
+        std::shared_ptr<const Container> collection;
+
+        // parts keep the collection alive as well
+        SharedSequenceStreamExtractor split(size_t from, size_t to) const {
+            return SharedSequenceStreamExtractor(collection, SequenceType::split(from, to));
+        }
+    };
+
+
+    namespace traits {
+        template<typename IteratorType>
+        std::is_base_of<std::forward_iterator_tag, typename std::iterator_traits<IteratorType>::iterator_category>
+            walksCollection(const SequenceStreamExtractor<IteratorType>*);
+        std::false_type walksCollection(const void*);
+
+        // extractors over a collection, their elements stay in place after the stream advances. Input
+        // iterators may reuse the element, so they don't qualify
+        template<typename Extractor>
+        using HasStableElements = decltype(walksCollection(static_cast<const Extractor*>(nullptr)));
+    }
+
+
+    // How flatMap walks over the result of its transform:
+    //  - a stream is iterated through its own extractor;
+    //  - a collection referenced by an element of a collection source (e.g. in flatten()) is iterated
+    //    in place;
+    //  - any other collection is moved or copied into an OwningSequenceStreamExtractor: a reference
+    //    into the state of an upstream stage (e.g. the value cached by map()) isn't kept by copies of
+    //    the stream, nor past the next advance.
+    template<typename Result, bool InPlace, bool = traits::IsStream<std::decay_t<Result>>::value>
+    struct FlatMapInner;
+
+    template<typename Result, bool InPlace>
+    struct FlatMapInner<Result, InPlace, true> {
+        using type = std::decay_t<decltype(std::declval<Result>().extractor)>;
+
+        static type make(Result&& result) {
+            return std::forward<Result>(result).extractor;
+        }
+    };
+
+    template<typename Result>
+    struct FlatMapInner<Result, true, false> {
+        using type = SequenceStreamExtractor<decltype(std::begin(std::declval<Result>()))>;
+
+        static type make(Result&& result) {
+            return type(std::begin(result), std::end(result));
+        }
+    };
+
+    template<typename Result>
+    struct FlatMapInner<Result, false, false> {
+        using type = OwningSequenceStreamExtractor<std::decay_t<Result>>;
+
+        static type make(Result&& result) {
+            return type(std::decay_t<Result>(std::forward<Result>(result)));
+        }
+    };
+
+
+    template<typename ExtractorType, typename Transform>
+    struct FlatMapStreamExtractor : StreamExtractor<FlatMapStreamExtractor<ExtractorType, Transform>>, FunctorStorage<Transform> {
+        FlatMapStreamExtractor(ExtractorType sourceExtractor, Transform&& transform) : FunctorStorage<Transform>(std::forward<Transform>(transform)), source(sourceExtractor) {}
+
+        using Result = traits::ApplyOnValueType<ExtractorType, Transform>;
+        using Inner = FlatMapInner<Result, std::is_lvalue_reference<Result>::value && traits::HasStableElements<ExtractorType>::value>;
+
+        ExtractorType source;
+        Optional<typename Inner::type> inner {};
+
+        static constexpr bool splittable = ExtractorType::splittable;
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        // the first part also takes the rest of the current inner stream
+        FlatMapStreamExtractor split(size_t from, size_t to) const {
+            FlatMapStreamExtractor part(source.split(from, to), Transform(this->functor()));
+            if (from == 0 && inner) {
+                part.inner.emplace(*inner);
+            }
+            return part;
+        }
+
+        auto get_impl() {
+            return inner->get();
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            while (!inner || inner->forEachWhile(sink)) {
+                if (!source.advance()) {
+                    return true;
+                }
+                inner.emplace(Inner::make(this->functor()(*source.get())));
+            }
+            return false;
+        }
+
+        bool advance_impl() {
+            while (!inner || !inner->advance()) {
+                if (!source.advance()) {
+                    return false;
+                }
+                inner.emplace(Inner::make(this->functor()(*source.get())));
+            }
+            return true;
+        }
+
+    };
+
+
+    template<typename ExtractorType, typename Inspector>
+    struct InspectStreamExtractor : StreamExtractor<InspectStreamExtractor<ExtractorType, Inspector>>, FunctorStorage<Inspector> {
+        CONSTEXPR InspectStreamExtractor(ExtractorType extractor, Inspector&& inspector) : FunctorStorage<Inspector>(std::forward<Inspector>(inspector)), source(extractor) {}
+
+        ExtractorType source;
+
+        static constexpr bool splittable = ExtractorType::splittable;
+        static constexpr bool oneToOne = ExtractorType::oneToOne;
+
+        CONSTEXPR auto get_impl() {
+            return source.get();
+        }
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        InspectStreamExtractor split(size_t from, size_t to) const {
+            return InspectStreamExtractor(source.split(from, to), Inspector(this->functor()));
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint();
+        }
+
+        CONSTEXPR bool advance_impl() {
+            if (source.advance()) {
+                this->functor()(*source.get());
+                return true;
+            }
+            return false;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            return source.forEachWhile([this, &sink](auto&& e) {
+                this->functor()(e);
+                return sink(std::forward<decltype(e)>(e));
+            });
+        }
+
+    };
+
+
+    template<typename ExtractorType, typename Inspector>
+    struct SpyStreamExtractor : StreamExtractor<SpyStreamExtractor<ExtractorType, Inspector>>, FunctorStorage<Inspector> {
+        CONSTEXPR SpyStreamExtractor(ExtractorType extractor, Inspector&& inspector) : FunctorStorage<Inspector>(std::forward<Inspector>(inspector)), source(extractor) {}
+
+        ExtractorType source;
+
+        static constexpr bool splittable = ExtractorType::splittable;
+        static constexpr bool oneToOne = ExtractorType::oneToOne;
+        static constexpr bool randomAccess = ExtractorType::randomAccess;
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        SpyStreamExtractor split(size_t from, size_t to) const {
+            return SpyStreamExtractor(source.split(from, to), Inspector(this->functor()));
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint();
+        }
+
+        CONSTEXPR auto get_impl() {
+            auto value = source.get();
+            this->functor()(*value);
+            return value;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            return source.forEachWhile([this, &sink](auto&& e) {
+                this->functor()(e);
+                return sink(std::forward<decltype(e)>(e));
+            });
+        }
+
+        CONSTEXPR bool advance_impl() {
+            return source.advance();
+        }
+
+        CONSTEXPR size_t advanceBy_impl(size_t count) {
+            return source.advanceBy(count);
+        }
+
+    };
+
+
+    template<typename T>
+    struct Enumerated {
+        size_t i;
+        std::decay_t<T> v;
+        Enumerated& operator = (const Enumerated&) = default;
+    };
+
+    template<typename T>
+    bool operator == (const Enumerated<T>& lhs, const Enumerated<T>& rhs) {
+        return lhs.i == rhs.i && lhs.v == rhs.v;
+    }
+
+
+    template<typename ExtractorType>
+    struct EnumerateStreamExtractor : StreamExtractor<EnumerateStreamExtractor<ExtractorType>> {
+        CONSTEXPR EnumerateStreamExtractor(ExtractorType extractor, size_t counter = 0) : source(extractor), counter(counter){}
+
+        ExtractorType source;
+        size_t counter;
+        Enumerated<traits::ValueType<ExtractorType>> value {counter, {}};
+
+        // indices of a split part are only known when no element before it can be dropped
+        static constexpr bool splittable = ExtractorType::splittable && ExtractorType::oneToOne;
+        static constexpr bool oneToOne = ExtractorType::oneToOne;
+        static constexpr bool randomAccess = ExtractorType::randomAccess;
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        EnumerateStreamExtractor split(size_t from, size_t to) const {
+            return EnumerateStreamExtractor(source.split(from, to), counter + from);
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint();
+        }
+
+        CONSTEXPR auto get_impl() {
+            value = {counter - 1, *source.get()};
+            return &value;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            return source.forEachWhile([this, &sink](auto&& e) {
+                return sink(Enumerated<traits::ValueType<ExtractorType>>{counter++, std::forward<decltype(e)>(e)});
+            });
+        }
+
+        CONSTEXPR bool advance_impl() {
+            ++counter;
+            return source.advance();
+        }
+
+        CONSTEXPR size_t advanceBy_impl(size_t count) {
+            const size_t skipped = source.advanceBy(count);
+            counter += skipped;
+            return skipped;
+        }
+
+    };
+
+
+    // Like Enumerated, but `v` refers to the element of the source stream. The reference is only valid
+    // until the stream advances, for a stream over a collection it stays valid as long as the collection.
+    template<typename T>
+    struct EnumeratedRef {
+        size_t i;
+        const T& v;
+    };
+
+    template<typename T>
+    bool operator == (const EnumeratedRef<T>& lhs, const EnumeratedRef<T>& rhs) {
+        return lhs.i == rhs.i && lhs.v == rhs.v;
+    }
+
+
+    template<typename ExtractorType>
+    struct EnumerateRefStreamExtractor : StreamExtractor<EnumerateRefStreamExtractor<ExtractorType>> {
+        EnumerateRefStreamExtractor(ExtractorType extractor, size_t counter = 0) : source(extractor), counter(counter) {}
+
+        using view_type = EnumeratedRef<traits::ValueType<ExtractorType>>;
+
+        ExtractorType source;
+        size_t counter;
+        Optional<view_type> value {};
+
+        static constexpr bool splittable = ExtractorType::splittable && ExtractorType::oneToOne;
+        static constexpr bool oneToOne = ExtractorType::oneToOne;
+        static constexpr bool randomAccess = ExtractorType::randomAccess;
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        EnumerateRefStreamExtractor split(size_t from, size_t to) const {
+            return EnumerateRefStreamExtractor(source.split(from, to), counter + from);
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint();
+        }
+
+        auto get_impl() {
+            value.emplace(view_type{counter - 1, *source.get()});
+            return &*value;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            return source.forEachWhile([this, &sink](auto&& e) {
+                return sink(view_type{counter++, e});
+            });
+        }
+
+        bool advance_impl() {
+            ++counter;
+            return source.advance();
+        }
+
+        size_t advanceBy_impl(size_t count) {
+            const size_t skipped = source.advanceBy(count);
+            counter += skipped;
+            return skipped;
+        }
+
+    };
+
+
+    template<typename ExtractorType>
+    struct EnumerateTupleStreamExtractor : StreamExtractor<EnumerateTupleStreamExtractor<ExtractorType>> {
+        EnumerateTupleStreamExtractor(ExtractorType extractor, size_t counter = 0) : source(extractor), counter(counter) {}
+
+        ExtractorType source;
+        size_t counter;
+        std::tuple<size_t, traits::ValueType<ExtractorType>> value {counter, {}};
+
+        static constexpr bool splittable = ExtractorType::splittable && ExtractorType::oneToOne;
+        static constexpr bool oneToOne = ExtractorType::oneToOne;
+        static constexpr bool randomAccess = ExtractorType::randomAccess;
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        EnumerateTupleStreamExtractor split(size_t from, size_t to) const {
+            return EnumerateTupleStreamExtractor(source.split(from, to), counter + from);
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint();
+        }
+
+        auto get_impl() {
+            value = std::make_tuple(counter - 1, *source.get());
+            return &value;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            return source.forEachWhile([this, &sink](auto&& e) {
+                return sink(std::tuple<size_t, traits::ValueType<ExtractorType>>(counter++, std::forward<decltype(e)>(e)));
+            });
+        }
+
+        bool advance_impl() {
+            ++counter;
+            return source.advance();
+        }
+
+        size_t advanceBy_impl(size_t count) {
+            const size_t skipped = source.advanceBy(count);
+            counter += skipped;
+            return skipped;
+        }
+
+    };
+
+
+    template<typename ExtractorType, typename ExtractorOtherType>
+    struct ChainStreamExtractor : StreamExtractor<ChainStreamExtractor<ExtractorType, ExtractorOtherType>> {
+        CONSTEXPR ChainStreamExtractor(ExtractorType extractor, ExtractorOtherType other) : first(extractor), next(other){}
+
+        ExtractorType first;
+        ExtractorOtherType next;
+        bool firstHaveElements = true;
+
+        static constexpr bool randomAccess = ExtractorType::randomAccess && ExtractorOtherType::randomAccess;
+
+        SizeHint sizeHint_impl() const {
+            return firstHaveElements ? first.sizeHint() + next.sizeHint() : next.sizeHint();
+        }
+
+        CONSTEXPR auto get_impl() {
+            if (firstHaveElements) {
+                return first.get();
+            } else {
+                return next.get();
+            }
+        }
+
+        CONSTEXPR bool advance_impl() {
+            if (firstHaveElements && (firstHaveElements = first.advance())) {
+                return true;
+            }
+            return next.advance();
+        }
+
+        CONSTEXPR size_t advanceBy_impl(size_t count) {
+            size_t skipped = 0;
+            if (firstHaveElements) {
+                skipped = first.advanceBy(count);
+                if (skipped == count) {
+                    return skipped;
+                }
+                firstHaveElements = false;
+            }
+            return skipped + next.advanceBy(count - skipped);
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            if (firstHaveElements) {
+                if (!first.forEachWhile(sink)) {
+                    return false;
+                }
+                firstHaveElements = false;
+            }
+            return next.forEachWhile(sink);
+        }
+
+    };
+
+
+    template<typename ExtractorType, typename ExtractorOtherType>
+    struct ZipStreamExtractor : StreamExtractor<ZipStreamExtractor<ExtractorType, ExtractorOtherType>> {
+        ZipStreamExtractor(ExtractorType extractor, ExtractorOtherType other) : left(extractor), right(other) {}
+
+        ExtractorType left;
+        ExtractorOtherType right;
+        std::tuple<traits::ValueType<ExtractorType>, traits::ValueType<ExtractorOtherType>> value {};
+
+        static constexpr bool splittable = ExtractorType::splittable && ExtractorType::oneToOne
+                                        && ExtractorOtherType::splittable && ExtractorOtherType::oneToOne;
+        static constexpr bool oneToOne = ExtractorType::oneToOne && ExtractorOtherType::oneToOne;
+        static constexpr bool randomAccess = ExtractorType::randomAccess && ExtractorOtherType::randomAccess;
+
+        size_t splitSize() const {
+            return std::min(left.splitSize(), right.splitSize());
+        }
+
+        ZipStreamExtractor split(size_t from, size_t to) const {
+            return ZipStreamExtractor(left.split(from, to), right.split(from, to));
+        }
+
+        SizeHint sizeHint_impl() const {
+            return SizeHint::min(left.sizeHint(), right.sizeHint());
+        }
+
+        auto get_impl() {
+            value = std::make_tuple(*left.get(), *right.get());
+            return &value;
+        }
+
+        bool advance_impl() {
+            return left.advance() && right.advance();
+        }
+
+        size_t advanceBy_impl(size_t count) {
+            const size_t skipped = left.advanceBy(count);
+            return std::min(skipped, right.advanceBy(skipped));
+        }
+
+    };
+
+
+    // Yields std::tuple<const L&, const R&> referring to the elements of both sources
+    template<typename ExtractorType, typename ExtractorOtherType>
+    struct ZipRefStreamExtractor : StreamExtractor<ZipRefStreamExtractor<ExtractorType, ExtractorOtherType>> {
+        ZipRefStreamExtractor(ExtractorType extractor, ExtractorOtherType other) : left(extractor), right(other) {}
+
+        using view_type = std::tuple<traits::ConstReference<ExtractorType>, traits::ConstReference<ExtractorOtherType>>;
+
+        ExtractorType left;
+        ExtractorOtherType right;
+        Optional<view_type> value {};
+
+        static constexpr bool splittable = ExtractorType::splittable && ExtractorType::oneToOne
+                                        && ExtractorOtherType::splittable && ExtractorOtherType::oneToOne;
+        static constexpr bool oneToOne = ExtractorType::oneToOne && ExtractorOtherType::oneToOne;
+        static constexpr bool randomAccess = ExtractorType::randomAccess && ExtractorOtherType::randomAccess;
+
+        size_t splitSize() const {
+            return std::min(left.splitSize(), right.splitSize());
+        }
+
+        ZipRefStreamExtractor split(size_t from, size_t to) const {
+            return ZipRefStreamExtractor(left.split(from, to), right.split(from, to));
+        }
+
+        SizeHint sizeHint_impl() const {
+            return SizeHint::min(left.sizeHint(), right.sizeHint());
+        }
+
+        auto get_impl() {
+            value.emplace(*left.get(), *right.get());
+            return &*value;
+        }
+
+        bool advance_impl() {
+            return left.advance() && right.advance();
+        }
+
+        size_t advanceBy_impl(size_t count) {
+            const size_t skipped = left.advanceBy(count);
+            return std::min(skipped, right.advanceBy(skipped));
+        }
+
+    };
+
+
+    template<typename ExtractorType>
+    struct PurifyStreamExtractor : StreamExtractor<PurifyStreamExtractor<ExtractorType>> {
+        CONSTEXPR PurifyStreamExtractor(ExtractorType extractor) : source(extractor), value() {}
+
+        ExtractorType source;
+        using source_optional_type = traits::ValueType<ExtractorType>;
+        static_assert(traits::IsOptional<source_optional_type>(), "Expected Optional<T> as a source");
+        using value_type = std::remove_const_t<typename source_optional_type::value_type>;
+        value_type value;
+
+        static constexpr bool splittable = ExtractorType::splittable;
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        PurifyStreamExtractor split(size_t from, size_t to) const {
+            return PurifyStreamExtractor(source.split(from, to));
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint().filtered();
+        }
+
+        CONSTEXPR auto get_impl() {
+            value = **source.get();
+            return &value;
+        }
+
+        CONSTEXPR bool advance_impl() {
+            while (source.advance()) {
+                if (*source.get() != nullopt) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            return source.forEachWhile([&sink](auto&& e) {
+                return !e || sink(*e);
+            });
+        }
+
+    };
+
+
+    // Skips elements equal to the one yielded before, which is kept as a copy
+    template<typename ExtractorType, typename Equal>
+    struct DedupStreamExtractor : StreamExtractor<DedupStreamExtractor<ExtractorType, Equal>>, FunctorStorage<Equal> {
+        DedupStreamExtractor(ExtractorType extractor, Equal&& equal) : FunctorStorage<Equal>(std::forward<Equal>(equal)), source(extractor), last() {}
+
+        using value_type = traits::ValueType<ExtractorType>;
+
+        ExtractorType source;
+        Optional<std::remove_const_t<value_type>> last;
+
+        SizeHint sizeHint_impl() const {
+            const SizeHint hint = source.sizeHint();
+            return{ std::min<size_t>(hint.lower, 1), hint.upper };
+        }
+
+        auto get_impl() {
+            return source.get();
+        }
+
+        bool advance_impl() {
+            while (source.advance()) {
+                auto& e = *source.get();
+                if (!last || !this->functor()(*last, e)) {
+                    last.emplace(e);
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+
+    // Where merge() reads its sources from: `advance(sources, i)` steps source i and returns a pointer
+    // to its element, nullptr once it is depleted
+    template<typename Sources>
+    struct MergeSources;
+
+    template<typename ExtractorType>
+    struct MergeSources<std::vector<ExtractorType>> {
+        using value_type = std::remove_const_t<traits::ValueType<ExtractorType>>;
+
+        static size_t size(const std::vector<ExtractorType>& sources) {
+            return sources.size();
+        }
+
+        static const value_type* advance(std::vector<ExtractorType>& sources, size_t i) {
+            return sources[i].advance() ? &*sources[i].get() : nullptr;
+        }
+
+        static const value_type* get(std::vector<ExtractorType>& sources, size_t i) {
+            return &*sources[i].get();
+        }
+
+        static SizeHint sizeHint(const std::vector<ExtractorType>& sources) {
+            SizeHint hint = SizeHint::exactly(0);
+            for (auto& source : sources) {
+                hint = hint + source.sizeHint();
+            }
+            return hint;
+        }
+    };
+
+    // different extractor types are stepped through a table of functions, one per tuple element
+    template<typename First, typename... Rest>
+    struct MergeSources<std::tuple<First, Rest...>> {
+        using value_type = std::remove_const_t<traits::ValueType<First>>;
+        using Tuple = std::tuple<First, Rest...>;
+
+        static constexpr size_t size(const Tuple&) {
+            return sizeof...(Rest) + 1;
+        }
+
+        static const value_type* advance(Tuple& sources, size_t i) {
+            return call<true>(sources, i, std::index_sequence_for<First, Rest...>{});
+        }
+
+        static const value_type* get(Tuple& sources, size_t i) {
+            return call<false>(sources, i, std::index_sequence_for<First, Rest...>{});
+        }
+
+        static SizeHint sizeHint(const Tuple& sources) {
+            return sizeHint(sources, std::index_sequence_for<First, Rest...>{});
+        }
+
+    private:
+        template<bool Advance, size_t I>
+        static const value_type* callSource(Tuple& sources) {
+            auto& source = std::get<I>(sources);
+            return !Advance || source.advance() ? &*source.get() : nullptr;
+        }
+
+        template<bool Advance, size_t... I>
+        static const value_type* call(Tuple& sources, size_t i, std::index_sequence<I...>) {
+            static const value_type* (*const functions[])(Tuple&) = { &callSource<Advance, I>... };
+            return functions[i](sources);
+        }
+
+        template<size_t... I>
+        static SizeHint sizeHint(const Tuple& sources, std::index_sequence<I...>) {
+            SizeHint hint = SizeHint::exactly(0);
+            for (const SizeHint& part : { std::get<I>(sources).sizeHint()... }) {
+                hint = hint + part;
+            }
+            return hint;
+        }
+    };
+
+
+    // Merges sorted sources with a loser tree: `losers[0]` is the source holding the least element,
+    // node n in [1, k) the source that lost there, and sources are leaves k..2k-1. After the winner
+    // advances only its path to the root is replayed, about log2(k) comparisons per element. Equal
+    // elements come from the earlier source first.
+    template<typename Sources, typename Compare>
+    struct MergeStreamExtractor : StreamExtractor<MergeStreamExtractor<Sources, Compare>>, FunctorStorage<Compare> {
+        using Access = MergeSources<Sources>;
+        using value_type = const typename Access::value_type;
+
+        MergeStreamExtractor(Sources sources, Compare&& compare)
+            : FunctorStorage<Compare>(std::forward<Compare>(compare)), sources(std::move(sources)), heads(), losers() {}
+
+        // the current elements of a copy are taken from its own sources
+        MergeStreamExtractor(const MergeStreamExtractor& other)
+            : FunctorStorage<Compare>(other), sources(other.sources), heads(other.heads), losers(other.losers), started(other.started) {
+            for (size_t i = 0; i < heads.size(); ++i) {
+                if (heads[i]) {
+                    heads[i] = Access::get(sources, i);
+                }
+            }
+        }
+
+        Sources sources;
+        std::vector<value_type*> heads;    // the current element of every source, nullptr when depleted
+        std::vector<size_t> losers;
+        bool started = false;
+
+        SizeHint sizeHint_impl() const {
+            const SizeHint hint = Access::sizeHint(sources);
+            if (!started) {
+                return hint;
+            }
+            size_t pending = 0;
+            for (auto head : heads) {
+                pending += head != nullptr;
+            }
+            return hint + SizeHint::exactly(pending == 0 ? 0 : pending - 1);
+        }
+
+        auto get_impl() {
+            return heads[losers[0]];
+        }
+
+        bool advance_impl() {
+            const size_t k = Access::size(sources);
+            if (k == 0) {
+                return false;
+            }
+            if (!started) {
+                started = true;
+                heads.resize(k);
+                losers.resize(k);
+                for (size_t i = 0; i < k; ++i) {
+                    heads[i] = Access::advance(sources, i);
+                }
+                losers[0] = build(1, k);
+            } else if (heads[losers[0]]) {
+                size_t winner = losers[0];
+                heads[winner] = Access::advance(sources, winner);
+                for (size_t node = (winner + k) / 2; node != 0; node /= 2) {
+                    if (beats(losers[node], winner)) {
+                        std::swap(losers[node], winner);
+                    }
+                }
+                losers[0] = winner;
+            }
+            return heads[losers[0]] != nullptr;
+        }
+
+    private:
+        bool beats(size_t a, size_t b) {
+            if (!heads[a] || !heads[b]) {
+                return heads[a] != nullptr;
+            }
+            if (this->functor()(*heads[a], *heads[b])) {
+                return true;
+            }
+            return !this->functor()(*heads[b], *heads[a]) && a < b;
+        }
+
+        // plays the matches below `node`, returns the winner
+        size_t build(size_t node, size_t k) {
+            if (node >= k) {
+                return node - k;
+            }
+            const size_t left = build(2 * node, k);
+            const size_t right = build(2 * node + 1, k);
+            const bool leftWins = beats(left, right);
+            losers[node] = leftWins ? right : left;
+            return leftWins ? left : right;
+        }
+    };
+
+
+    // A view of consecutive elements yielded by chunks() and windows()
+    template<typename T>
+    struct Span {
+        const T* first;
+        size_t length;
+
+        CONSTEXPR const T* data() const { return first; }
+        CONSTEXPR const T* begin() const { return first; }
+        CONSTEXPR const T* end() const { return first + length; }
+        CONSTEXPR size_t size() const { return length; }
+        CONSTEXPR bool empty() const { return length == 0; }
+        CONSTEXPR const T& operator [] (size_t i) const { return first[i]; }
+        CONSTEXPR const T& front() const { return first[0]; }
+        CONSTEXPR const T& back() const { return first[length - 1]; }
+    };
+
+
+    // Chunks of a contiguous sequence point into its storage
+    template<typename ExtractorType, bool = ExtractorType::contiguous>
+    struct ChunksStreamExtractor : StreamExtractor<ChunksStreamExtractor<ExtractorType, true>> {
+        ChunksStreamExtractor(ExtractorType extractor, size_t size) : source(extractor), size(size) {}
+
+        using value_type = traits::ValueType<ExtractorType>;
+
+        ExtractorType source;
+        size_t size;
+        Span<value_type> value {nullptr, 0};
+
+        SizeHint sizeHint_impl() const {
+            const size_t left = static_cast<size_t>(source.end - source.rest());
+            return SizeHint::exactly(left / size + (left % size != 0));
+        }
+
+        auto get_impl() {
+            return &value;
+        }
+
+        bool advance_impl() {
+            const auto first = source.rest();
+            if (first == source.end) {
+                return false;
+            }
+            value = { &*first, source.advanceBy(size) };
+            return true;
+        }
+    };
+
+    // Chunks of any other stream are copied into a buffer allocated once
+    template<typename ExtractorType>
+    struct ChunksStreamExtractor<ExtractorType, false> : StreamExtractor<ChunksStreamExtractor<ExtractorType, false>> {
+        ChunksStreamExtractor(ExtractorType extractor, size_t size) : source(extractor), buffer(size), length(0) {}
+
+        using value_type = traits::ValueType<ExtractorType>;
+
+        ExtractorType source;
+        std::vector<value_type> buffer;
+        size_t length;
+        Span<value_type> value {nullptr, 0};
+
+        SizeHint sizeHint_impl() const {
+            const SizeHint hint = source.sizeHint();
+            return{ chunks(hint.lower), hint.upper ? Optional<size_t>(chunks(*hint.upper)) : nullopt };
+        }
+
+        auto get_impl() {
+            value = { buffer.data(), length };
+            return &value;
+        }
+
+        bool advance_impl() {
+            length = 0;
+            while (length != buffer.size() && source.advance()) {
+                buffer[length++] = *source.get();
+            }
+            return length != 0;
+        }
+
+    private:
+        size_t chunks(size_t count) const {
+            return count / buffer.size() + (count % buffer.size() != 0);
+        }
+    };
+
+
+    // Windows over a contiguous sequence point into its storage
+    template<typename ExtractorType, bool = ExtractorType::contiguous>
+    struct WindowsStreamExtractor : StreamExtractor<WindowsStreamExtractor<ExtractorType, true>> {
+        WindowsStreamExtractor(ExtractorType extractor, size_t size) : source(extractor), size(size) {}
+
+        using value_type = traits::ValueType<ExtractorType>;
+
+        ExtractorType source;
+        size_t size;
+        Span<value_type> value {nullptr, 0};
+
+        SizeHint sizeHint_impl() const {
+            const size_t left = static_cast<size_t>(source.end - source.rest());
+            return SizeHint::exactly(left >= size ? left - size + 1 : 0);
+        }
+
+        auto get_impl() {
+            return &value;
+        }
+
+        bool advance_impl() {
+            const auto first = source.rest();
+            if (static_cast<size_t>(source.end - first) < size) {
+                return false;
+            }
+            value = { &*first, size };
+            source.advanceBy(1);
+            return true;
+        }
+    };
+
+    // Windows over any other stream live in a ring buffer of twice the window size: every element is
+    // stored twice, `size` slots apart, so the latest `size` elements are always contiguous
+    template<typename ExtractorType>
+    struct WindowsStreamExtractor<ExtractorType, false> : StreamExtractor<WindowsStreamExtractor<ExtractorType, false>> {
+        WindowsStreamExtractor(ExtractorType extractor, size_t size) : source(extractor), size(size), buffer(2 * size), head(0), filled(0) {}
+
+        using value_type = traits::ValueType<ExtractorType>;
+
+        ExtractorType source;
+        size_t size;
+        std::vector<value_type> buffer;
+        size_t head;   // the oldest element of a full window, the next slot to overwrite
+        size_t filled;
+        Span<value_type> value {nullptr, 0};
+
+        SizeHint sizeHint_impl() const {
+            const SizeHint hint = source.sizeHint();
+            return{ windows(hint.lower), hint.upper ? Optional<size_t>(windows(*hint.upper)) : nullopt };
+        }
+
+        auto get_impl() {
+            value = { buffer.data() + head, size };
+            return &value;
+        }
+
+        bool advance_impl() {
+            do {
+                if (!source.advance()) {
+                    return false;
+                }
+                buffer[head] = *source.get();
+                buffer[head + size] = buffer[head];
+                head = head + 1 == size ? 0 : head + 1;
+            } while (filled != size && ++filled != size);
+            return true;
+        }
+
+    private:
+        // windows left among `count` more elements
+        size_t windows(size_t count) const {
+            if (filled == size) {
+                return count;
+            }
+            const size_t total = saturatingAdd(count, filled);
+            return total >= size ? total - size + 1 : 0;
+        }
+    };
+
+
+    // A sorted run of elements for SortedStreamExtractor. Runs of trivially copyable elements may be
+    // spilled to a temporary file and read back through a buffer; a run stays in memory when the
+    // file can't be created or written. Reading a spilled run back throws std::system_error on failure.
+    template<typename T>
+    struct SortedRun {
+        std::vector<T> buffer;
+        size_t position;
+        std::shared_ptr<std::FILE> file;
+        std::fpos_t offset; // of the first element in the file not read yet, copies share the file
+        size_t spilled;     // elements left in the file
+
+        explicit SortedRun(std::vector<T>&& elements) : buffer(std::move(elements)), position(0), file(), offset(), spilled(0) {}
+
+        bool empty() const {
+            return position == buffer.size();
+        }
+
+        const T& front() const {
+            return buffer[position];
+        }
+
+        size_t size() const {
+            return buffer.size() - position + spilled;
+        }
+
+        void pop(size_t bufferSize) {
+            if (++position == buffer.size() && spilled != 0) {
+                refill(bufferSize);
+            }
+        }
+
+        void spill() {
+            spill(std::is_trivially_copyable<T>{});
+        }
+
+        // keeps at most `bufferSize` elements of a spilled run in memory
+        void refill(size_t bufferSize) {
+            const size_t count = std::min(bufferSize, spilled);
+            buffer.resize(count);
+            position = 0;
+            if (count == 0) {
+                return;
+            }
+            errno = 0;
+            if (std::fsetpos(file.get(), &offset) != 0 || std::fread(buffer.data(), sizeof(T), count, file.get()) != count
+                || std::fgetpos(file.get(), &offset) != 0) {
+                throw std::system_error(errno != 0 ? errno : EIO, std::generic_category(), "read a spilled run of sorted()");
+            }
+            spilled -= count;
+        }
+
+    private:
+        void spill(std::true_type) {
+            std::shared_ptr<std::FILE> tmp(std::tmpfile(), [](std::FILE* f) { if (f) std::fclose(f); });
+            if (!tmp || std::fgetpos(tmp.get(), &offset) != 0 || std::fwrite(buffer.data(), sizeof(T), buffer.size(), tmp.get()) != buffer.size()
+                || std::fflush(tmp.get()) != 0) {
+                return;
+            }
+            file = std::move(tmp);
+            spilled = buffer.size();
+            buffer.clear();
+            buffer.shrink_to_fit();
+        }
+
+        void spill(std::false_type) {}
+    };
+
+
+    // Sorts the whole source on the first advance(). Up to `budget` elements are sorted in memory at a
+    // time, larger inputs become several sorted runs (spilled to temporary files when possible) that are
+    // merged lazily. Equal elements keep their order.
+    template<typename ExtractorType, typename Compare>
+    struct SortedStreamExtractor : StreamExtractor<SortedStreamExtractor<ExtractorType, Compare>>, FunctorStorage<Compare> {
+        SortedStreamExtractor(ExtractorType extractor, Compare&& compare, size_t budget)
+            : FunctorStorage<Compare>(std::forward<Compare>(compare)), source(extractor), budget(budget), runs(), heap() {}
+
+        using value_type = traits::ValueType<ExtractorType>;
+
+        ExtractorType source;
+        size_t budget;
+        std::vector<SortedRun<value_type>> runs;
+        std::vector<size_t> heap;  // runs to merge, except the one holding the current element
+        size_t current = 0;
+        bool started = false;
+
+        SizeHint sizeHint_impl() const {
+            if (!started) {
+                return source.sizeHint();
+            }
+            size_t size = 0;
+            for (auto& run : runs) {
+                size += run.size();
+            }
+            return SizeHint::exactly(current < runs.size() ? size - 1 : size);
+        }
+
+        auto get_impl() {
+            return &runs[current].front();
+        }
+
+        bool advance_impl() {
+            if (!started) {
+                started = true;
+                sortRuns();
+            } else if (current < runs.size()) {
+                runs[current].pop(bufferSize());
+                if (!runs[current].empty()) {
+                    heap.push_back(current);
+                    std::push_heap(heap.begin(), heap.end(), order());
+                }
+            }
+            if (heap.empty()) {
+                current = runs.size();
+                return false;
+            }
+            std::pop_heap(heap.begin(), heap.end(), order());
+            current = heap.back();
+            heap.pop_back();
+            return true;
+        }
+
+    private:
+        void sortRuns() {
+            std::vector<value_type> chunk;
+            bool depleted = false;
+            while (!depleted) {
+                while (!(depleted = !source.advance())) {
+                    chunk.push_back(*source.get());
+                    if (chunk.size() == budget) {
+                        break;
+                    }
+                }
+                if (chunk.empty()) {
+                    break;
+                }
+                std::stable_sort(chunk.begin(), chunk.end(), this->functor());
+                runs.emplace_back(std::move(chunk));
+                chunk.clear();
+                if (!depleted || runs.size() > 1) {
+                    runs.back().spill();
+                }
+            }
+            for (size_t i = 0; i < runs.size(); ++i) {
+                if (runs[i].empty()) {
+                    runs[i].refill(bufferSize());
+                }
+                if (!runs[i].empty()) {
+                    heap.push_back(i);
+                }
+            }
+            std::make_heap(heap.begin(), heap.end(), order());
+        }
+
+        // the merge buffers of all runs together hold about `budget` elements
+        size_t bufferSize() const {
+            return std::max<size_t>(1, budget / std::max<size_t>(1, runs.size()));
+        }
+
+        // a max-heap comparator putting the least front on top, earlier runs first among equal ones
+        auto order() {
+            return [this](size_t lhs, size_t rhs) {
+                const auto& l = runs[lhs].front();
+                const auto& r = runs[rhs].front();
+                return this->functor()(r, l) || (!this->functor()(l, r) && rhs < lhs);
+            };
+        }
+    };
+
+    // The single-producer/single-consumer ring buffer behind buffered(). The producer thread owns `tail`
+    // and the consumer owns `head`; each side caches the other's index and reloads it only when the
+    // buffer looks full or empty. The consumer hands slots back a quarter of the buffer at a time, and
+    // whenever it has to wait. A side that has to wait spins for a while and then sleeps until the
+    // other one moves its index. The destructor stops the producer and joins it.
+    template<typename T>
+    struct BufferChannel {
+        explicit BufferChannel(size_t capacity) : slots(capacity), producer(), error(), mutex(), wakeup() {}
+
+        BufferChannel(const BufferChannel&) = delete;
+        BufferChannel& operator = (const BufferChannel&) = delete;
+
+        ~BufferChannel() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopped.store(true);
+            }
+            wakeup.notify_all();
+            if (producer.joinable()) {
+                producer.join();
+            }
+        }
+
+        std::vector<Optional<T>> slots;
+        std::thread producer;
+        std::exception_ptr error;   // published by `finished`
+
+        // consumer side, `read` is the element yielded last and `head` the first slot not handed back
+        std::atomic<size_t> head{ 0 };
+        size_t read = 0;
+        size_t cachedTail = 0;
+        char consumerPadding[64] = {};
+
+        // producer side
+        std::atomic<size_t> tail{ 0 };
+        size_t cachedHead = 0;
+        char producerPadding[64] = {};
+
+        std::atomic<bool> finished{ false };
+        std::atomic<bool> stopped{ false };
+
+        // a side sets its flag before it sleeps, the other one notifies only while it is set
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::atomic<bool> producerWaiting{ false };
+        std::atomic<bool> consumerWaiting{ false };
+
+        static constexpr int spinLimit = 64;
+
+        // runs `source` from its `skip`-th element on
+        template<typename Extractor>
+        void start(Extractor source, size_t skip) {
+            producer = std::thread([this, source, skip]() mutable {
+                try {
+                    if (source.advanceBy(skip) == skip) {
+                        source.forEachWhile([this](auto&& e) {
+                            return push(std::forward<decltype(e)>(e));
+                        });
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                finished.store(true);
+                notify(consumerWaiting);
+            });
+        }
+
+        // false once the consumer is gone
+        template<typename U>
+        bool push(U&& value) {
+            const size_t index = tail.load(std::memory_order_relaxed);
+            if (index - cachedHead == slots.size()) {
+                await(producerWaiting, [this, index] {
+                    cachedHead = head.load(std::memory_order_acquire);
+                    return index - cachedHead != slots.size() || stopped.load();
+                });
+                if (index - cachedHead == slots.size()) {
+                    return false;
+                }
+            }
+            slots[index % slots.size()] = std::forward<U>(value);
+            tail.store(index + 1, std::memory_order_release);
+            notify(consumerWaiting);
+            return !stopped.load(std::memory_order_relaxed);
+        }
+
+        T* front() {
+            return &*slots[read % slots.size()];
+        }
+
+        // moves past the current element
+        void pop() {
+            if (++read - head.load(std::memory_order_relaxed) >= std::max<size_t>(1, slots.size() / 4)) {
+                release();
+            }
+        }
+
+        // waits for the element after the current one; false when the producer is done, rethrowing
+        // an exception thrown upstream
+        bool wait() {
+            const size_t index = read;
+            if (index == cachedTail) {
+                release();
+                await(consumerWaiting, [this, index] {
+                    const bool done = finished.load(std::memory_order_acquire);
+                    cachedTail = tail.load(std::memory_order_acquire);
+                    return index != cachedTail || done;
+                });
+                if (index == cachedTail) {
+                    if (error) {
+                        std::rethrow_exception(error);
+                    }
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        // hands the slots before the current element back to the producer
+        void release() {
+            if (head.load(std::memory_order_relaxed) != read) {
+                head.store(read, std::memory_order_release);
+                notify(producerWaiting);
+            }
+        }
+
+        // The waiting side sets its flag and then checks the indices, the other side moves an index
+        // and then checks the flag, both across a seq_cst fence: at least one of them sees the other's
+        // store, so either the waiter doesn't sleep or it is notified. The predicate is checked under
+        // the mutex the notifier takes, so a notification can't fall between the check and the sleep.
+        template<typename Ready>
+        void await(std::atomic<bool>& waiting, Ready&& ready) {
+            for (int spin = 0; spin < spinLimit; ++spin) {
+                if (ready()) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wakeup.wait(lock, ready);
+            waiting.store(false, std::memory_order_relaxed);
+        }
+
+        void notify(std::atomic<bool>& waiting) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiting.load(std::memory_order_relaxed)) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                }
+                wakeup.notify_all();
+            }
+        }
+    };
+
+
+    // Runs the source on a producer thread started by the first advance(), handing elements over
+    // through a BufferChannel of `capacity` elements. A channel has a single consumer, so a copy of a
+    // started stream runs the source again on a channel of its own, from the element after the current one.
+    template<typename ExtractorType>
+    struct BufferedStreamExtractor : StreamExtractor<BufferedStreamExtractor<ExtractorType>> {
+        BufferedStreamExtractor(ExtractorType extractor, size_t capacity) : source(extractor), capacity(capacity), channel() {}
+
+        BufferedStreamExtractor(const BufferedStreamExtractor& other)
+            : source(other.source), capacity(other.capacity), channel(), consumed(other.consumed) {}
+
+        BufferedStreamExtractor(BufferedStreamExtractor&&) = default;
+
+        using value_type = traits::ValueType<ExtractorType>;
+        using Channel = BufferChannel<std::remove_const_t<value_type>>;
+
+        ExtractorType source;   // the producer runs a copy
+        size_t capacity;
+        std::shared_ptr<Channel> channel;
+        size_t consumed = 0;
+        bool yielded = false;
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint().skip(consumed);
+        }
+
+        auto get_impl() {
+            return channel->front();
+        }
+
+        bool advance_impl() {
+            if (!channel) {
+                channel = std::make_shared<Channel>(capacity);
+                channel->start(source, consumed);
+            } else if (yielded) {
+                channel->pop();
+            }
+            yielded = channel->wait();
+            consumed += yielded;
+            return yielded;
+        }
+    };
+
+
+    // Worker threads of parMap(). Inputs are transformed a window at a time: the consumer fills a
+    // window from the source and submits it in batches, the workers write every result into its
+    // own slot, and the window is read in order once all its batches are done.
+    template<typename Input, typename Output, typename Transform>
+    struct TransformPool {
+        struct Window {
+            std::vector<Input> inputs;
+            std::vector<Optional<Output>> outputs;
+            size_t pending = 0;         // batches not done yet, guarded by the pool mutex
+            std::exception_ptr error;
+
+            Window() : inputs(), outputs(), error() {}
+        };
+
+        struct Batch {
+            Window* window;
+            size_t begin;
+            size_t end;
+        };
+
+        TransformPool(const Transform& transform, size_t threads, size_t batch)
+            : transform(transform), batch(batch), windows(), mutex(), submitted(), done(), jobs(), workers() {
+            for (size_t i = 0; i < threads; ++i) {
+                try {
+                    workers.emplace_back([this] { work(); });
+                } catch (...) {
+                    // the workers started so far take all batches
+                    if (workers.empty()) {
+                        throw;
+                    }
+                    break;
+                }
+            }
+        }
+
+        TransformPool(const TransformPool&) = delete;
+        TransformPool& operator = (const TransformPool&) = delete;
+
+        // batches not started yet are dropped
+        ~TransformPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            submitted.notify_all();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        Transform transform;
+        size_t batch;
+        Window windows[2];
+        std::mutex mutex;
+        std::condition_variable submitted;
+        std::condition_variable done;
+        std::deque<Batch> jobs;
+        std::vector<std::thread> workers;
+        bool stopping = false;
+
+        void submit(Window& window) {
+            const size_t size = window.inputs.size();
+            window.outputs.clear();
+            window.outputs.resize(size);
+            window.error = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (size_t begin = 0; begin < size; begin += batch) {
+                    jobs.push_back({ &window, begin, std::min(size, begin + batch) });
+                    ++window.pending;
+                }
+            }
+            submitted.notify_all();
+        }
+
+        // waits for the results of `window`, rethrowing an exception thrown by the transform
+        void wait(Window& window) {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [&window] { return window.pending == 0; });
+            if (window.error) {
+                std::rethrow_exception(window.error);
+            }
+        }
+
+    private:
+        void work() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                submitted.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                const Batch job = jobs.front();
+                jobs.pop_front();
+                lock.unlock();
+                std::exception_ptr error;
+                try {
+                    for (size_t i = job.begin; i < job.end; ++i) {
+                        job.window->outputs[i].emplace(transform(job.window->inputs[i]));
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                lock.lock();
+                if (error && !job.window->error) {
+                    job.window->error = error;
+                }
+                if (--job.window->pending == 0) {
+                    done.notify_all();
+                }
+            }
+        }
+    };
+
+
+    // Applies the transform on worker threads and yields the results in the source order. The source
+    // is read on the calling thread a window of `threads * batch` elements ahead: one window is yielded
+    // while the next one is transformed. A copy of a started stream starts workers of its own and
+    // carries over the inputs read ahead but not yielded yet, transforming them again.
+    template<typename ExtractorType, typename Transform>
+    struct ParMapStreamExtractor : StreamExtractor<ParMapStreamExtractor<ExtractorType, Transform>>, FunctorStorage<Transform> {
+        ParMapStreamExtractor(ExtractorType extractor, Transform&& transform, size_t threads, size_t batch)
+            : FunctorStorage<Transform>(std::forward<Transform>(transform)), source(extractor), threads(threads), batch(batch), pool(), carried() {}
+
+        ParMapStreamExtractor(const ParMapStreamExtractor& other)
+            : FunctorStorage<Transform>(other), source(other.source), threads(other.threads), batch(other.batch), pool(), carried() {
+            if (other.pool) {
+                const auto& yielding = other.pool->windows[other.current].inputs;
+                const auto& next = other.pool->windows[1 - other.current].inputs;
+                carried.insert(carried.end(), yielding.begin() + static_cast<std::ptrdiff_t>(other.position), yielding.end());
+                carried.insert(carried.end(), next.begin(), next.end());
+            }
+            carried.insert(carried.end(), other.carried.begin() + static_cast<std::ptrdiff_t>(other.carriedPosition), other.carried.end());
+        }
+
+        ParMapStreamExtractor(ParMapStreamExtractor&&) = default;
+
+        using input_type = std::remove_const_t<traits::ValueType<ExtractorType>>;
+        using value_type = std::decay_t<traits::ApplyOnValueType<ExtractorType, Transform>>;
+        using Pool = TransformPool<input_type, value_type, Transform>;
+
+        ExtractorType source;
+        size_t threads;
+        size_t batch;
+        std::shared_ptr<Pool> pool;
+        size_t current = 0;             // window being yielded
+        size_t position = 0;            // in that window, one past the current element
+        std::vector<input_type> carried;    // inputs of the copied stream, read before the source
+        size_t carriedPosition = 0;
+
+        SizeHint sizeHint_impl() const {
+            size_t buffered = carried.size() - carriedPosition;
+            if (pool) {
+                buffered += pool->windows[current].inputs.size() - position + pool->windows[1 - current].inputs.size();
+            }
+            return source.sizeHint() + SizeHint::exactly(buffered);
+        }
+
+        auto get_impl() {
+            return &*pool->windows[current].outputs[position - 1];
+        }
+
+        bool advance_impl() {
+            if (!pool) {
+                pool = std::make_shared<Pool>(this->functor(), threads, batch);
+                fill(pool->windows[0]);
+                fill(pool->windows[1]);
+                pool->wait(pool->windows[0]);
+            } else if (position == pool->windows[current].inputs.size()) {
+                if (position == 0) {
+                    return false;
+                }
+                fill(pool->windows[current]);
+                current = 1 - current;
+                position = 0;
+                pool->wait(pool->windows[current]);
+            }
+            if (position == pool->windows[current].inputs.size()) {
+                return false;
+            }
+            ++position;
+            return true;
+        }
+
+    private:
+        void fill(typename Pool::Window& window) {
+            window.inputs.clear();
+            const size_t size = threads * batch;
+            while (window.inputs.size() < size && carriedPosition < carried.size()) {
+                window.inputs.push_back(std::move(carried[carriedPosition++]));
+            }
+            while (window.inputs.size() < size && source.advance()) {
+                window.inputs.push_back(*source.get());
+            }
+            pool->submit(window);
+        }
+    };
+
+
+    // Counters of a stage marked with profiled(): advance() calls, elements produced and the time spent
+    // in advance() and get(), which includes the stages before it
+    struct StageProfile {
+        std::string name;
+        size_t pulls;
+        size_t produced;
+        std::chrono::nanoseconds time;
+    };
+
+    // The stages marked with profiled() along one pipeline, from the source on. `report` runs when the
+    // last stream sharing the profile is destroyed, i.e. after the terminal operation on a temporary.
+    struct PipelineProfile {
+        std::vector<StageProfile> stages;
+        std::function<void(const PipelineProfile&)> report;
+
+        PipelineProfile() : stages(), report(), mutex() {}
+        PipelineProfile(const PipelineProfile&) = delete;
+        PipelineProfile& operator = (const PipelineProfile&) = delete;
+
+        ~PipelineProfile() {
+            try {
+                if (report) {
+                    report(*this);
+                }
+            } catch (...) {}
+        }
+
+        // the time of the stage without the profiled stages before it
+        std::chrono::nanoseconds selfTime(size_t stage) const {
+            return stage == 0 ? stages[0].time : stages[stage].time - stages[stage - 1].time;
+        }
+
+        // the share of elements from the previous profiled stage that pass this one
+        double selectivity(size_t stage) const {
+            const size_t input = stage == 0 ? stages[0].produced : stages[stage - 1].produced;
+            return input == 0 ? 1.0 : static_cast<double>(stages[stage].produced) / static_cast<double>(input);
+        }
+
+        std::string table() const {
+            std::string table = "stage                    pulls     produced  selectivity     time ms     self ms\n";
+            char line[160];
+            for (size_t i = 0; i < stages.size(); ++i) {
+                std::snprintf(line, sizeof(line), "%-20.20s %9zu %12zu %12.4f %11.3f %11.3f\n", stages[i].name.c_str(), stages[i].pulls,
+                              stages[i].produced, selectivity(i), static_cast<double>(stages[i].time.count()) / 1e6,
+                              static_cast<double>(selfTime(i).count()) / 1e6);
+                table += line;
+            }
+            return table;
+        }
+
+        static void printToStderr(const PipelineProfile& profile) {
+            std::fputs(profile.table().c_str(), stderr);
+        }
+
+        // every profiled extractor, parts of a parallel stream included, adds its counters once it is destroyed
+        void add(size_t stage, size_t pulls, size_t produced, std::chrono::nanoseconds time) {
+            std::lock_guard<std::mutex> lock(mutex);
+            StageProfile& counters = stages[stage];
+            counters.pulls += pulls;
+            counters.produced += produced;
+            counters.time += time;
+        }
+
+    private:
+        std::mutex mutex;
+    };
+
+    // Times and counts the calls to the stages before it, see PipelineProfile. The counters are kept in
+    // the extractor and added to the profile when it is destroyed; a copy starts from zero. Elements
+    // pushed by forEachWhile() or forEachBlock() are counted in the sink and the whole call is timed. The
+    // time spent in the sink, i.e. downstream, is left out: it is measured per block, and on every
+    // `sampleEvery`-th element pushed one by one and extrapolated. The capabilities of the source are kept,
+    // so the profiled pipeline runs as it does without profiling, parallel parts included. Contiguity
+    // isn't, as chunks and windows over a contiguous source would bypass the stage.
+    template<typename ExtractorType>
+    struct ProfiledStreamExtractor : StreamExtractor<ProfiledStreamExtractor<ExtractorType>> {
+        using value_type = traits::ValueType<ExtractorType>;
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr size_t sampleEvery = 64;
+
+        ProfiledStreamExtractor(ExtractorType extractor, std::shared_ptr<PipelineProfile> profile, size_t stage)
+            : source(extractor), profile(std::move(profile)), stage(stage), pulls(0), produced(0), time() {}
+
+        ProfiledStreamExtractor(const ProfiledStreamExtractor& other)
+            : source(other.source), profile(other.profile), stage(other.stage), pulls(0), produced(0), time() {}
+
+        ProfiledStreamExtractor(ProfiledStreamExtractor&& other)
+            : source(std::move(other.source)), profile(std::move(other.profile)), stage(other.stage)
+            , pulls(std::exchange(other.pulls, 0)), produced(std::exchange(other.produced, 0)), time(std::exchange(other.time, Clock::duration())) {}
+
+        ProfiledStreamExtractor& operator = (const ProfiledStreamExtractor& other) {
+            if (this != &other) {
+                flush();
+                source = other.source;
+                profile = other.profile;
+                stage = other.stage;
+            }
+            return *this;
+        }
+
+        ProfiledStreamExtractor& operator = (ProfiledStreamExtractor&& other) {
+            if (this != &other) {
+                flush();
+                source = std::move(other.source);
+                profile = std::move(other.profile);
+                stage = other.stage;
+                pulls = std::exchange(other.pulls, 0);
+                produced = std::exchange(other.produced, 0);
+                time = std::exchange(other.time, Clock::duration());
+            }
+            return *this;
+        }
+
+        ~ProfiledStreamExtractor() {
+            flush();
+        }
+
+        ExtractorType source;
+        std::shared_ptr<PipelineProfile> profile;
+        size_t stage;
+        size_t pulls;
+        size_t produced;
+        Clock::duration time;
+
+        static constexpr bool splittable = ExtractorType::splittable;
+        static constexpr bool oneToOne = ExtractorType::oneToOne;
+        static constexpr bool randomAccess = ExtractorType::randomAccess;
+        static constexpr bool blockwise = ExtractorType::blockwise;
+
+        size_t splitSize() const {
+            return source.splitSize();
+        }
+
+        ProfiledStreamExtractor split(size_t from, size_t to) const {
+            return ProfiledStreamExtractor(source.split(from, to), profile, stage);
+        }
+
+        SizeHint sizeHint_impl() const {
+            return source.sizeHint();
+        }
+
+        auto get_impl() {
+            const auto start = Clock::now();
+            auto value = source.get();
+            time += Clock::now() - start;
+            return value;
+        }
+
+        bool advance_impl() {
+            const auto start = Clock::now();
+            const bool advanced = source.advance();
+            time += Clock::now() - start;
+            ++pulls;
+            produced += advanced;
+            return advanced;
+        }
+
+        size_t advanceBy_impl(size_t count) {
+            const auto start = Clock::now();
+            const size_t skipped = source.advanceBy(count);
+            time += Clock::now() - start;
+            pulls += skipped + (skipped != count);
+            produced += skipped;
+            return skipped;
+        }
+
+        template<typename Sink>
+        bool forEachWhile_impl(Sink&& sink) {
+            size_t pushed = 0;
+            size_t sampled = 0;
+            Clock::duration downstream{};
+            const auto start = Clock::now();
+            const bool depleted = source.forEachWhile([&sink, &pushed, &sampled, &downstream](auto&& e) {
+                if (pushed++ % sampleEvery != 0) {
+                    return sink(std::forward<decltype(e)>(e));
+                }
+                ++sampled;
+                const auto offered = Clock::now();
+                const bool more = sink(std::forward<decltype(e)>(e));
+                downstream += Clock::now() - offered;
+                return more;
+            });
+            const Clock::duration elapsed = Clock::now() - start;
+            if (sampled != 0) {
+                downstream = std::chrono::duration_cast<Clock::duration>(downstream * (static_cast<double>(pushed) / static_cast<double>(sampled)));
+            }
+            time += std::max(elapsed - downstream, Clock::duration::zero());
+            pulls += pushed + depleted;
+            produced += pushed;
+            return depleted;
+        }
+
+        template<typename BlockSink>
+        void forEachBlock(BlockSink&& sink) {
+            size_t pushed = 0;
+            Clock::duration downstream{};
+            const auto start = Clock::now();
+            source.forEachBlock([&sink, &pushed, &downstream](const auto* data, size_t size) {
+                pushed += size;
+                const auto offered = Clock::now();
+                sink(data, size);
+                downstream += Clock::now() - offered;
+            });
+            time += Clock::now() - start - downstream;
+            pulls += pushed + 1;
+            produced += pushed;
+        }
+
+    private:
+        void flush() {
+            if (profile && (pulls != 0 || time != Clock::duration::zero())) {
+                profile->add(stage, pulls, produced, std::chrono::duration_cast<std::chrono::nanoseconds>(time));
+            }
+            pulls = 0;
+            produced = 0;
+            time = Clock::duration::zero();
+        }
+    };
+
+    template<typename ExtractorType>
+    constexpr size_t ProfiledStreamExtractor<ExtractorType>::sampleEvery;
+
+    // the profile of the nearest profiled stage up the `source` chain, call with 0
+    template<typename ExtractorType>
+    std::shared_ptr<PipelineProfile> profileOf(const ProfiledStreamExtractor<ExtractorType>& extractor, int) {
+        return extractor.profile;
+    }
+
+    template<typename ExtractorType>
+    auto profileOf(const ExtractorType& extractor, int) -> decltype(profileOf(extractor.source, 0)) {
+        return profileOf(extractor.source, 0);
+    }
+
+    template<typename ExtractorType>
+    std::shared_ptr<PipelineProfile> profileOf(const ExtractorType&, long) {
+        return nullptr;
+    }
+
+
+    // An open addressing hash map built by groupBy() and countBy(). Entries are stored densely in
+    // insertion order; the index table holds a hash and an entry number per slot and is probed linearly,
+    // so a lookup touches one or two cache lines and no node is allocated per key.
+    template<typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+    struct FlatHashMap : private FunctorStorage<Hash, 0>, private FunctorStorage<KeyEqual, 1> {
+        using value_type = std::pair<Key, Value>;
+        using const_iterator = typename std::vector<value_type>::const_iterator;
+
+        FlatHashMap(Hash hash = {}, KeyEqual equal = {})
+            : FunctorStorage<Hash, 0>(std::move(hash)), FunctorStorage<KeyEqual, 1>(std::move(equal)), entries(), slots() {}
+
+        size_t size() const { return entries.size(); }
+        bool empty() const { return entries.empty(); }
+        const_iterator begin() const { return entries.begin(); }
+        const_iterator end() const { return entries.end(); }
+
+        // makes room for `count` keys without rehashing
+        void reserve(size_t count) {
+            entries.reserve(count);
+            size_t capacity = slots.empty() ? minCapacity : slots.size();
+            while (capacity / 4 * 3 < count) {
+                capacity *= 2;
+            }
+            if (capacity != slots.size()) {
+                rehash(capacity);
+            }
+        }
+
+        // the value of `key`, constructed from `args` if the key is new; only an insertion grows the table
+        template<typename K, typename... Args>
+        Value& tryEmplace(K&& key, Args&&... args) {
+            const size_t hash = mix(FunctorStorage<Hash, 0>::functor()(key));
+            size_t index = slots.empty() ? 0 : lookup(key, hash);
+            if (!slots.empty() && slots[index].entry != 0) {
+                return entries[slots[index].entry - 1].second;
+            }
+            if ((entries.size() + 1) > slots.size() / 4 * 3) {
+                rehash(slots.empty() ? minCapacity : slots.size() * 2);
+                index = lookup(key, hash);
+            }
+            entries.emplace_back(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+            slots[index] = { hash, entries.size() };
+            return entries.back().second;
+        }
+
+        Value& operator [] (const Key& key) {
+            return tryEmplace(key);
+        }
+
+        const Value* find(const Key& key) const {
+            if (slots.empty()) {
+                return nullptr;
+            }
+            const Slot& slot = slots[lookup(key, mix(FunctorStorage<Hash, 0>::functor()(key)))];
+            return slot.entry == 0 ? nullptr : &entries[slot.entry - 1].second;
+        }
+
+        Value* find(const Key& key) {
+            return const_cast<Value*>(static_cast<const FlatHashMap&>(*this).find(key));
+        }
+
+        size_t count(const Key& key) const {
+            return find(key) ? 1 : 0;
+        }
+
+        // the entries ordered by key
+        template<typename Compare = std::less<Key>>
+        std::vector<value_type> sortedByKey(Compare compare = {}) const & {
+            return sorted(entries, compare);
+        }
+
+        template<typename Compare = std::less<Key>>
+        std::vector<value_type> sortedByKey(Compare compare = {}) && {
+            return sorted(std::move(entries), compare);
+        }
+
+    private:
+        struct Slot {
+            size_t hash;
+            size_t entry;   // index in `entries` plus one, zero for an empty slot
+        };
+
+        static constexpr size_t minCapacity = 16;
+
+        std::vector<value_type> entries;
+        std::vector<Slot> slots;    // a power of two in size, at most 3/4 full
+
+        // Fibonacci hashing spreads the identity hashes of nearby integers over the table
+        static size_t mix(size_t hash) {
+            const unsigned long long h = static_cast<unsigned long long>(hash) * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+
+        // the slot holding `key` or the empty slot where it belongs
+        template<typename K>
+        size_t lookup(const K& key, size_t hash) const {
+            const size_t mask = slots.size() - 1;
+            size_t i = hash & mask;
+            while (slots[i].entry != 0
+                   && !(slots[i].hash == hash && FunctorStorage<KeyEqual, 1>::functor()(entries[slots[i].entry - 1].first, key))) {
+                i = (i + 1) & mask;
+            }
+            return i;
+        }
+
+        void rehash(size_t capacity) {
+            std::vector<Slot> old(capacity, Slot{ 0, 0 });
+            old.swap(slots);
+            const size_t mask = capacity - 1;
+            for (const Slot& slot : old) {
+                if (slot.entry != 0) {
+                    size_t i = slot.hash & mask;
+                    while (slots[i].entry != 0) {
+                        i = (i + 1) & mask;
+                    }
+                    slots[i] = slot;
+                }
+            }
+        }
+
+        template<typename Entries, typename Compare>
+        static std::vector<value_type> sorted(Entries&& entries, Compare& compare) {
+            std::vector<value_type> result(std::forward<Entries>(entries));
+            std::sort(result.begin(), result.end(), [&compare](const value_type& l, const value_type& r) {
+                return compare(l.first, r.first);
+            });
+            return result;
+        }
+    };
+
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    constexpr size_t FlatHashMap<Key, Value, Hash, KeyEqual>::minCapacity;
+
+
+    // The elements a join keeps from one side: pointers when they stay in place, copies otherwise
+    template<typename ExtractorType, bool = traits::HasStableElements<ExtractorType>::value>
+    struct JoinItems {
+        using value_type = traits::ValueType<ExtractorType>;
+
+        std::vector<const value_type*> items;
+
+        JoinItems() : items() {}
+
+        void push(ExtractorType& source) { items.push_back(&*source.get()); }
+        const value_type& operator [] (size_t i) const { return *items[i]; }
+        size_t size() const { return items.size(); }
+        void clear() { items.clear(); }
+    };
+
+    template<typename ExtractorType>
+    struct JoinItems<ExtractorType, false> {
+        using value_type = traits::ValueType<ExtractorType>;
+
+        std::vector<value_type> items;
+
+        JoinItems() : items() {}
+
+        void push(ExtractorType& source) { items.push_back(*source.get()); }
+        const value_type& operator [] (size_t i) const { return items[i]; }
+        size_t size() const { return items.size(); }
+        void clear() { items.clear(); }
+    };
+
+
+    // The build side of a hash join: the items of every key are adjacent in `order`, a FlatHashMap
+    // numbers the keys and `starts` holds where every key's items begin
+    template<typename ExtractorType, typename Key>
+    struct JoinTable {
+        using value_type = traits::ValueType<ExtractorType>;
+
+        JoinItems<ExtractorType> items;
+        std::vector<size_t> order;
+        std::vector<size_t> starts;
+        FlatHashMap<Key, size_t> groups;
+
+        JoinTable() : items(), order(), starts(), groups() {}
+
+        template<typename KeyFunction>
+        void build(ExtractorType& source, KeyFunction& key) {
+            std::vector<size_t> itemGroups;
+            while (source.advance()) {
+                items.push(source);
+                const size_t newGroup = groups.size();
+                itemGroups.push_back(groups.tryEmplace(key(items[items.size() - 1]), newGroup));
+            }
+            // counting sort of the items by group
+            starts.assign(groups.size() + 1, 0);
+            for (size_t group : itemGroups) {
+                ++starts[group + 1];
+            }
+            for (size_t i = 1; i < starts.size(); ++i) {
+                starts[i] += starts[i - 1];
+            }
+            std::vector<size_t> next(starts.begin(), starts.end() - 1);
+            order.resize(itemGroups.size());
+            for (size_t i = 0; i < itemGroups.size(); ++i) {
+                order[next[itemGroups[i]]++] = i;
+            }
+        }
+
+        // the range of positions in `order` holding items with `key`
+        std::pair<size_t, size_t> find(const Key& key) const {
+            const size_t* group = groups.find(key);
+            return group ? std::make_pair(starts[*group], starts[*group + 1]) : std::make_pair(size_t{ 0 }, size_t{ 0 });
+        }
+
+        const value_type& at(size_t position) const {
+            return items[order[position]];
+        }
+    };
+
+
+    // Inner join of two streams sorted by key: every left element is paired with the run of right
+    // elements with an equal key, which is kept until a left element with another key comes
+    template<typename Left, typename Right, typename KeyLeft, typename KeyRight, typename Compare>
+    struct MergeJoinStreamExtractor : StreamExtractor<MergeJoinStreamExtractor<Left, Right, KeyLeft, KeyRight, Compare>>,
+                                      FunctorStorage<KeyLeft, 0>, FunctorStorage<KeyRight, 1>, FunctorStorage<Compare, 2> {
+        MergeJoinStreamExtractor(Left left, Right right, KeyLeft&& keyLeft, KeyRight&& keyRight, Compare&& compare)
+            : FunctorStorage<KeyLeft, 0>(std::forward<KeyLeft>(keyLeft)), FunctorStorage<KeyRight, 1>(std::forward<KeyRight>(keyRight))
+            , FunctorStorage<Compare, 2>(std::forward<Compare>(compare)), left(left), right(right), group() {}
+
+        using view_type = std::tuple<traits::ConstReference<Left>, traits::ConstReference<Right>>;
+
+        Left left;
+        Right right;
+        JoinItems<Right> group;     // the right elements matching the current left one
+        size_t position = 0;        // one past the current element of `group`
+        bool started = false;
+        bool rightPending = false;  // the current right element isn't in a group yet
+        Optional<view_type> value {};
+
+        auto get_impl() {
+            value.emplace(*left.get(), group[position - 1]);
+            return &*value;
+        }
+
+        bool advance_impl() {
+            if (!started) {
+                started = true;
+                rightPending = right.advance();
+            }
+            if (position != 0 && position < group.size()) {
+                ++position;
+                return true;
+            }
+            while (left.advance()) {
+                const auto& key = FunctorStorage<KeyLeft, 0>::functor()(*left.get());
+                if (group.size() != 0 && equal(FunctorStorage<KeyRight, 1>::functor()(group[0]), key)) {
+                    position = 1;
+                    return true;
+                }
+                group.clear();
+                position = 0;
+                while (rightPending && less(FunctorStorage<KeyRight, 1>::functor()(*right.get()), key)) {
+                    rightPending = right.advance();
+                }
+                if (!rightPending) {
+                    return false;
+                }
+                while (rightPending && equal(FunctorStorage<KeyRight, 1>::functor()(*right.get()), key)) {
+                    group.push(right);
+                    rightPending = right.advance();
+                }
+                if (group.size() != 0) {
+                    position = 1;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        template<typename L, typename R>
+        bool less(const L& lhs, const R& rhs) {
+            return FunctorStorage<Compare, 2>::functor()(lhs, rhs);
+        }
+
+        template<typename L, typename R>
+        bool equal(const L& lhs, const R& rhs) {
+            return !less(lhs, rhs) && !less(rhs, lhs);
+        }
+    };
+
+
+    // Inner join through a JoinTable built from the side known to be smaller when first advanced (the
+    // right one unless the left one is bounded and the right one isn't, or is larger), the other side
+    // is streamed and looked up
+    template<typename Left, typename Right, typename KeyLeft, typename KeyRight>
+    struct HashJoinStreamExtractor : StreamExtractor<HashJoinStreamExtractor<Left, Right, KeyLeft, KeyRight>>,
+                                     FunctorStorage<KeyLeft, 0>, FunctorStorage<KeyRight, 1> {
+        HashJoinStreamExtractor(Left left, Right right, KeyLeft&& keyLeft, KeyRight&& keyRight)
+            : FunctorStorage<KeyLeft, 0>(std::forward<KeyLeft>(keyLeft)), FunctorStorage<KeyRight, 1>(std::forward<KeyRight>(keyRight))
+            , left(left), right(right), leftTable(), rightTable() {}
+
+        using view_type = std::tuple<traits::ConstReference<Left>, traits::ConstReference<Right>>;
+        using Key = std::decay_t<traits::ApplyOnValueType<Left, KeyLeft>>;
+
+        Left left;
+        Right right;
+        JoinTable<Left, Key> leftTable;
+        JoinTable<Right, Key> rightTable;
+        size_t position = 0;        // one past the current match in the table
+        size_t end = 0;             // of the matches of the streamed element
+        bool started = false;
+        bool buildLeft = false;
+        Optional<view_type> value {};
+
+        auto get_impl() {
+            if (buildLeft) {
+                value.emplace(leftTable.at(position - 1), *right.get());
+            } else {
+                value.emplace(*left.get(), rightTable.at(position - 1));
+            }
+            return &*value;
+        }
+
+        bool advance_impl() {
+            if (!started) {
+                started = true;
+                const SizeHint leftHint = left.sizeHint();
+                const SizeHint rightHint = right.sizeHint();
+                buildLeft = leftHint.upper && (!rightHint.upper || *leftHint.upper < *rightHint.upper);
+                if (buildLeft) {
+                    leftTable.build(left, FunctorStorage<KeyLeft, 0>::functor());
+                } else {
+                    rightTable.build(right, FunctorStorage<KeyRight, 1>::functor());
+                }
+            }
+            if (position < end) {
+                ++position;
+                return true;
+            }
+            while (buildLeft ? right.advance() : left.advance()) {
+                const auto matches = buildLeft ? leftTable.find(FunctorStorage<KeyRight, 1>::functor()(*right.get()))
+                                               : rightTable.find(FunctorStorage<KeyLeft, 0>::functor()(*left.get()));
+                if (matches.first != matches.second) {
+                    position = matches.first + 1;
+                    end = matches.second;
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+
+    // Aggregators for aggregate(). An aggregator takes elements with add(e), combines with a partial
+    // result of the same type with merge(other) (used by parallel streams) and returns result(). Any
+    // type following that protocol can be passed to aggregate() too.
+    namespace aggregators {
+        template<typename T>
+        struct Count {
+            size_t count = 0;
+
+            void add(const T&) { ++count; }
+            void merge(const Count& other) { count += other.count; }
+            size_t result() const { return count; }
+        };
+
+        template<typename T>
+        struct Sum {
+            T sum {};
+
+            void add(const T& e) { sum += e; }
+            void merge(const Sum& other) { sum += other.sum; }
+            T result() const { return sum; }
+        };
+
+        // the least element by Compare, see Min and Max
+        template<typename T, typename Compare>
+        struct Extremum {
+            Optional<T> value {};
+
+            void add(const T& e) {
+                if (!value || Compare{}(e, *value)) {
+                    value = e;
+                }
+            }
+
+            void merge(const Extremum& other) {
+                if (other.value) {
+                    add(*other.value);
+                }
+            }
+
+            Optional<T> result() const { return value; }
+        };
+
+        template<typename T>
+        using Min = Extremum<T, std::less<T>>;
+
+        template<typename T>
+        using Max = Extremum<T, std::greater<T>>;
+
+        // a running mean, so large sums don't lose precision
+        template<typename T>
+        struct Mean {
+            size_t count = 0;
+            double mean = 0;
+
+            void add(const T& e) {
+                ++count;
+                mean += (static_cast<double>(e) - mean) / static_cast<double>(count);
+            }
+
+            void merge(const Mean& other) {
+                if (other.count != 0) {
+                    const size_t total = count + other.count;
+                    mean += (other.mean - mean) * static_cast<double>(other.count) / static_cast<double>(total);
+                    count = total;
+                }
+            }
+
+            Optional<double> result() const { return count != 0 ? Optional<double>(mean) : nullopt; }
+        };
+
+        // Welford's algorithm, partial results are merged as described by Chan et al.
+        template<typename T>
+        struct Variance {
+            size_t count = 0;
+            double mean = 0;
+            double m2 = 0;      // the sum of squared differences from the mean
+
+            void add(const T& e) {
+                ++count;
+                const double delta = static_cast<double>(e) - mean;
+                mean += delta / static_cast<double>(count);
+                m2 += delta * (static_cast<double>(e) - mean);
+            }
+
+            void merge(const Variance& other) {
+                if (other.count != 0) {
+                    const size_t total = count + other.count;
+                    const double delta = other.mean - mean;
+                    mean += delta * static_cast<double>(other.count) / static_cast<double>(total);
+                    m2 += other.m2 + delta * delta * static_cast<double>(count) * static_cast<double>(other.count) / static_cast<double>(total);
+                    count = total;
+                }
+            }
+
+            // the population variance
+            Optional<double> result() const { return count != 0 ? Optional<double>(m2 / static_cast<double>(count)) : nullopt; }
+
+            Optional<double> sample() const { return count > 1 ? Optional<double>(m2 / static_cast<double>(count - 1)) : nullopt; }
+        };
+
+        template<typename Tuple, size_t... I>
+        void mergeAll(Tuple& into, const Tuple& other, std::index_sequence<I...>) {
+            using Expand = int[];
+            (void)Expand{ 0, (std::get<I>(into).merge(std::get<I>(other)), 0)... };
+        }
+    }
+
+
+    // Fusion of adjacent adaptors: BaseStreamInterface builds extractors through these overloads, so
+    // map.map, filter.map and skip.take chains become a single stage
+    namespace fusion {
+        template<typename Source, typename Transform>
+        CONSTEXPR auto map(const Source& source, Transform&& transform) {
+            return MapStreamExtractor<Source, Transform>(source, std::forward<Transform>(transform));
+        }
+
+        template<typename Source, typename First, typename Transform>
+        CONSTEXPR auto map(const MapStreamExtractor<Source, First>& source, Transform&& transform) {
+            using Composed = ComposedTransform<First, Transform>;
+            return MapStreamExtractor<Source, Composed>(source.source, Composed(First(source.functor()), std::forward<Transform>(transform)));
+        }
+
+        template<typename Source, typename Predicate, typename Transform>
+        CONSTEXPR auto map(const FilterStreamExtractor<Source, Predicate>& source, Transform&& transform) {
+            return FilteredMapStreamExtractor<Source, Predicate, Transform>(source.source, Predicate(source.functor()), std::forward<Transform>(transform));
+        }
+
+        template<typename Source, typename Predicate, typename First, typename Transform>
+        CONSTEXPR auto map(const FilteredMapStreamExtractor<Source, Predicate, First>& source, Transform&& transform) {
+            using Composed = ComposedTransform<First, Transform>;
+            return FilteredMapStreamExtractor<Source, Predicate, Composed>(source.source, Predicate(source.predicate()),
+                                                                           Composed(First(source.transform()), std::forward<Transform>(transform)));
+        }
+
+        template<typename Source>
+        CONSTEXPR auto take(const Source& source, size_t count) {
+            return TakeStreamExtractor<Source>(source, count);
+        }
+
+        template<typename Source>
+        CONSTEXPR auto take(const SkipFirstStreamExtractor<Source>& source, size_t count) {
+            return SliceStreamExtractor<Source>(source.source, source.skipCount, count);
+        }
+
+        template<typename Source>
+        CONSTEXPR auto take(const SliceStreamExtractor<Source>& source, size_t count) {
+            return SliceStreamExtractor<Source>(source.source, source.skipCount, std::min(source.limit, count));
+        }
+    }
+
+    template<typename ExtractorType>
+    struct ParallelStreamInterface;
+
+    template<typename ExtractorType>
+    struct BaseStreamInterface {
+        ExtractorType extractor;
+        using value_type = std::remove_reference_t<decltype(*extractor.get())>;
+
+        CONSTEXPR BaseStreamInterface(ExtractorType e) : extractor(e) {}
+
+        // Intermediate Operations
+
+        template<typename Transform>
+        CONSTEXPR auto map(Transform&& transform) {
+            using Extractor = decltype(fusion::map(extractor, std::forward<Transform>(transform)));
+            return BaseStreamInterface<Extractor>(fusion::map(extractor, std::forward<Transform>(transform)));
+        }
+
+        // expects that the transform returns a stream or a collection std::begin and std::end can be called on,
+        // a collection returned by reference is iterated in place
+        template<typename Transform>
+        auto flatMap(Transform&& transform) {
+            using Extractor = FlatMapStreamExtractor<decltype(extractor), Transform>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Transform>(transform)));
+        }
+
+        // add flatten level
+        auto flatten() {
+            const auto flat = [](auto&& e) -> decltype(auto) { return std::forward<decltype(e)>(e); };
+            using Extractor = FlatMapStreamExtractor<decltype(extractor), decltype(flat)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::move(flat)));
+        }
+
+        template<typename Predicate>
+        CONSTEXPR auto filter(Predicate&& predicate) {
+            using Extractor = FilterStreamExtractor<decltype(extractor), Predicate>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Predicate>(predicate)));
+        }
+
+        template<typename Transform>
+        CONSTEXPR auto filterMap(Transform&& transform) {
+            using Extractor = FilterMapStreamExtractor<decltype(extractor), Transform>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Transform>(transform)));
+        }
+
+        CONSTEXPR auto skip(size_t count) {
+            using Extractor = SkipFirstStreamExtractor<decltype(extractor)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, count));
+        }
+
+        template<typename Predicate>
+        CONSTEXPR auto skipWhile(Predicate&& predicate) {
+            using Extractor = SkipWhileStreamExtractor<decltype(extractor), Predicate>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Predicate>(predicate)));
+        }
+
+        CONSTEXPR auto take(size_t count) {
+            using Extractor = decltype(fusion::take(extractor, count));
+            return BaseStreamInterface<Extractor>(fusion::take(extractor, count));
+        }
+
+        template<typename Predicate>
+        CONSTEXPR auto takeWhile(Predicate&& predicate) {
+            using Extractor = TakeWhileStreamExtractor<decltype(extractor), Predicate>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Predicate>(predicate)));
+        }
+
+        // a step of 0 is treated as 1
+        CONSTEXPR auto stepBy(size_t step) {
+            using Extractor = StepByStreamExtractor<decltype(extractor)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, step == 0 ? 1 : step));
+        }
+
+        template<typename Inspector>
+        CONSTEXPR auto inspect(Inspector&& inspector) {
+            using Extractor = InspectStreamExtractor<decltype(extractor), Inspector>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Inspector>(inspector)));
+        }
+
+        template<typename Inspector>
+        CONSTEXPR auto spy(Inspector&& inspector) {
+            using Extractor = SpyStreamExtractor<decltype(extractor), Inspector>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Inspector>(inspector)));
+        }
+
+        // records pulls, produced elements and time of the stream so far as a stage of a PipelineProfile
+        // shared with the profiled stages before it; the whole profile is handed to `report` once the
+        // pipeline is destroyed. Defining STREAMS_DISABLE_PROFILING removes the stage, and the name is
+        // only copied into a std::string when it doesn't.
+        template<typename Report>
+        auto profiled(StringView name, Report&& report) {
+#ifdef STREAMS_DISABLE_PROFILING
+            (void)name;
+            (void)report;
+            return *this;
+#else
+            std::shared_ptr<PipelineProfile> profile = profileOf(extractor, 0);
+            if (!profile) {
+                profile = std::make_shared<PipelineProfile>();
+            }
+            profile->report = std::forward<Report>(report);
+            profile->stages.push_back({ std::string(name), 0, 0, std::chrono::nanoseconds(0) });
+            using Extractor = ProfiledStreamExtractor<decltype(extractor)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, profile, profile->stages.size() - 1));
+#endif
+        }
+
+        // keeps the report of the profiled stages before, a table on stderr by default
+        auto profiled(StringView name) {
+#ifdef STREAMS_DISABLE_PROFILING
+            (void)name;
+            return *this;
+#else
+            std::shared_ptr<PipelineProfile> profile = profileOf(extractor, 0);
+            return profiled(name, profile ? profile->report : &PipelineProfile::printToStderr);
+#endif
+        }
+
+        CONSTEXPR auto enumerate(size_t from = 0) {
+            using Extractor = EnumerateStreamExtractor<decltype(extractor)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, from));
+        }
+
+        // yields EnumeratedRef: the index and a reference to the element instead of its copy
+        auto enumerateRef(size_t from = 0) {
+            using Extractor = EnumerateRefStreamExtractor<decltype(extractor)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, from));
+        }
+
+        auto enumerateTup(size_t from = 0) {
+            using Extractor = EnumerateTupleStreamExtractor<decltype(extractor)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, from));
+        }
+
+        template <template<typename> class StreamOther, typename OtherExtractor>
+        CONSTEXPR auto chain(StreamOther<OtherExtractor> other) {
+            using Extractor = ChainStreamExtractor<decltype(extractor), OtherExtractor>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, other.extractor));
+        }
+
+        template <template<typename> class StreamOther, typename OtherExtractor>
+        auto zip(StreamOther<OtherExtractor> other) {
+            using Extractor = ZipStreamExtractor<decltype(extractor), OtherExtractor>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, other.extractor));
+        }
+
+        // yields tuples of references to the elements of both streams instead of their copies
+        template <template<typename> class StreamOther, typename OtherExtractor>
+        auto zipRef(StreamOther<OtherExtractor> other) {
+            using Extractor = ZipRefStreamExtractor<decltype(extractor), OtherExtractor>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, other.extractor));
+        }
+
+        // tuples of references to the elements of this and the other stream with equal keys, both streams
+        // sorted by key in the order of `compare`; the right elements of a key are copied unless they
+        // come from a collection
+        template<typename OtherExtractor, typename KeyLeft, typename KeyRight, typename Compare = std::less<>>
+        auto mergeJoin(BaseStreamInterface<OtherExtractor> other, KeyLeft&& keyLeft, KeyRight&& keyRight, Compare&& compare = {}) {
+            using Extractor = MergeJoinStreamExtractor<decltype(extractor), OtherExtractor, KeyLeft, KeyRight, Compare>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, other.extractor, std::forward<KeyLeft>(keyLeft),
+                                                            std::forward<KeyRight>(keyRight), std::forward<Compare>(compare)));
+        }
+
+        // the same pairs for unsorted streams; the smaller stream is loaded into a hash table (copied
+        // unless it is a collection) and the other one is looked up element by element
+        template<typename OtherExtractor, typename KeyLeft, typename KeyRight>
+        auto hashJoin(BaseStreamInterface<OtherExtractor> other, KeyLeft&& keyLeft, KeyRight&& keyRight) {
+            using Extractor = HashJoinStreamExtractor<decltype(extractor), OtherExtractor, KeyLeft, KeyRight>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, other.extractor, std::forward<KeyLeft>(keyLeft), std::forward<KeyRight>(keyRight)));
+        }
+
+        // non-overlapping views of `size` elements, the last one may be shorter; a size of 0 is treated as 1.
+        // A view points into the source collection when it is contiguous, otherwise into a buffer of the
+        // stream, valid until it advances
+        auto chunks(size_t size) {
+            using Extractor = ChunksStreamExtractor<decltype(extractor)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, size == 0 ? 1 : size));
+        }
+
+        // views of every `size` consecutive elements, valid like the ones of chunks()
+        auto windows(size_t size) {
+            using Extractor = WindowsStreamExtractor<decltype(extractor)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, size == 0 ? 1 : size));
+        }
+
+        // maps elements on `threads` worker threads (0 means std::thread::hardware_concurrency()) in
+        // batches of `batch` elements, keeping the order; the transform has to be thread safe
+        template<typename Transform>
+        auto parMap(Transform&& transform, size_t threads = 0, size_t batch = 16) {
+            using Extractor = ParMapStreamExtractor<decltype(extractor), std::decay_t<Transform>>;
+            if (threads == 0) {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::decay_t<Transform>(std::forward<Transform>(transform)), threads, batch == 0 ? 1 : batch));
+        }
+
+        // drops elements equal to the one before them
+        template<typename Equal = std::equal_to<>>
+        auto dedup(Equal&& equal = {}) {
+            using Extractor = DedupStreamExtractor<decltype(extractor), Equal>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Equal>(equal)));
+        }
+
+        // runs the stream so far on a background thread that stays up to `capacity` elements ahead
+        auto buffered(size_t capacity = 1024) {
+            using Extractor = BufferedStreamExtractor<decltype(extractor)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, capacity == 0 ? 1 : capacity));
+        }
+
+        // sorts the stream when it is first advanced, keeping about `budget` elements in memory for
+        // larger inputs (see SortedStreamExtractor)
+        template<typename Compare = std::less<std::remove_const_t<value_type>>>
+        auto sorted(Compare&& compare = {}, size_t budget = std::numeric_limits<size_t>::max()) {
+            using Extractor = SortedStreamExtractor<decltype(extractor), Compare>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Compare>(compare), budget == 0 ? 1 : budget));
+        }
+
+        CONSTEXPR auto purify() {
+            static_assert(traits::IsOptional<value_type>(), "Purify should be called on a stream of Optional<T> values");
+            using Extractor = PurifyStreamExtractor<decltype(extractor)>;
+            return BaseStreamInterface<Extractor>(Extractor(extractor));
+        }
+
+        // threads == 0 means std::thread::hardware_concurrency()
+        auto parallel(size_t threads = 0) {
+            static_assert(ExtractorType::splittable, "Parallel execution requires a random-access source and a chain of filter/map-like adaptors");
+            return ParallelStreamInterface<ExtractorType>(extractor, threads);
+        }
+
+        // Non-Terminal
+
+        SizeHint sizeHint() const {
+            return extractor.sizeHint();
+        }
+
+        CONSTEXPR Optional<value_type> next() {
+            if (extractor.advance()) {
+                return{ *extractor.get() };
+            }
+            return{};
+        }
+
+        CONSTEXPR Optional<value_type> nth(size_t n) {
+            if (extractor.advanceBy(n) != n) {
+                return nullopt;
+            }
+            return next();
+        }
+        // Terminal Operations 
+
+        Optional<std::remove_const_t<value_type>> last() {
+            return last(traits::HasStableElements<ExtractorType>{});
+        }
+
+        template<typename Callable>
+        void forEach(Callable&& callable) {
+            extractor.forEachWhile([&callable](auto&& e) {
+                callable(e);
+                return true;
+            });
+        }
+
+        // elements are only advanced over, so callables whose results no filter needs (map, spy) don't run
+        CONSTEXPR size_t count() {
+            if (STREAMS_CONSTANT_EVALUATED()) {
+                return countPulling();
+            }
+            return count(std::integral_constant<bool, ExtractorType::blockwise && !ExtractorType::randomAccess>{});
+        }
+
+        template<typename Predicate>
+        CONSTEXPR bool any(Predicate&& predicate) {
+            if (STREAMS_CONSTANT_EVALUATED()) {
+                return anyPulling(predicate);
+            }
+            return !extractor.forEachWhile([&predicate](auto&& e) {
+                return !predicate(e);
+            });
+        }
+
+        template<typename Predicate>
+        CONSTEXPR bool all(Predicate&& predicate) {
+            if (STREAMS_CONSTANT_EVALUATED()) {
+                return allPulling(predicate);
+            }
+            return extractor.forEachWhile([&predicate](auto&& e) {
+                return static_cast<bool>(predicate(e));
+            });
+        }
+
+        template<typename Comparator = std::less<std::remove_const_t<value_type>>>
+        CONSTEXPR Optional<std::remove_const_t<value_type>> min(Comparator cmp = {}) {
+            using Value = std::remove_const_t<value_type>;
+            if (STREAMS_CONSTANT_EVALUATED()) {
+                return minPulling(cmp);
+            }
+            return min(cmp, std::integral_constant<bool, ExtractorType::blockwise
+                && (std::is_same<Comparator, std::less<Value>>::value || std::is_same<Comparator, std::greater<Value>>::value)>{});
+        }
+
+        template<typename Comparator = std::greater<std::remove_const_t<value_type>>>
+        CONSTEXPR Optional<std::remove_const_t<value_type>> max(Comparator cmp = {}) {
+            return min(cmp);
+        }
+
+        // the `k` least elements according to `cmp`, sorted; only `k` elements are kept at a time
+        template<typename Comparator = std::less<std::remove_const_t<value_type>>>
+        std::vector<std::remove_const_t<value_type>> topK(size_t k, Comparator cmp = {}) {
+            std::vector<std::remove_const_t<value_type>> heap;
+            if (k == 0) {
+                return heap;
+            }
+            const SizeHint hint = extractor.sizeHint();
+            heap.reserve(hint.upper ? std::min(k, *hint.upper) : std::min(k, hint.lower));
+            extractor.forEachWhile([&heap, &cmp, k](auto&& e) {
+                if (heap.size() < k) {
+                    heap.push_back(std::forward<decltype(e)>(e));
+                    std::push_heap(heap.begin(), heap.end(), cmp);
+                } else if (cmp(e, heap.front())) { // the front is the greatest element kept
+                    std::pop_heap(heap.begin(), heap.end(), cmp);
+                    heap.back() = std::forward<decltype(e)>(e);
+                    std::push_heap(heap.begin(), heap.end(), cmp);
+                }
+                return true;
+            });
+            std::sort_heap(heap.begin(), heap.end(), cmp);
+            return heap;
+        }
+
+        template<typename Predicate>
+        CONSTEXPR Optional<std::remove_const_t<value_type>> find(Predicate&& predicate) {
+            if (STREAMS_CONSTANT_EVALUATED()) {
+                return findPulling(predicate);
+            }
+            Optional<std::remove_const_t<value_type>> found {};
+            extractor.forEachWhile([&found, &predicate](auto&& e) {
+                if (predicate(e)) {
+                    found = std::forward<decltype(e)>(e);
+                    return false;
+                }
+                return true;
+            });
+            return found;
+        }
+
+        template<typename Predicate>
+        CONSTEXPR Optional<size_t> position(Predicate&& predicate) {
+            if (STREAMS_CONSTANT_EVALUATED()) {
+                return positionPulling(predicate);
+            }
+            size_t counter = 0;
+            const bool depleted = extractor.forEachWhile([&counter, &predicate](auto&& e) {
+                ++counter;
+                return !predicate(e);
+            });
+            return depleted ? nullopt : Optional<size_t>(counter);
+        }
+
+        template<typename Accumulator, typename Fold>
+        CONSTEXPR Accumulator fold(Accumulator a, Fold&& fold) {
+            if (STREAMS_CONSTANT_EVALUATED()) {
+                return foldPulling(std::move(a), fold);
+            }
+            return foldWith(std::move(a), fold, std::integral_constant<bool, ExtractorType::blockwise
+                && traits::IsPlus<std::decay_t<Fold>, std::remove_const_t<value_type>>::value>{});
+        }
+
+        // the first N elements, value-initialized past the end of the stream; works in constant expressions
+        template<size_t N>
+        CONSTEXPR std::array<std::remove_const_t<value_type>, N> collectArray() {
+            return collectArray(std::make_index_sequence<N>{});
+        }
+
+        template <template<class...> class Container = std::vector, typename Element = std::remove_const_t<value_type>>
+        auto collect() {
+            Container<Element> container;
+            appendTo(container);
+            return container;
+        }
+
+        // collects into a container using `allocator`, rebound to the element type (an arena or a pmr allocator)
+        template <template<class...> class Container = std::vector, typename Element = std::remove_const_t<value_type>, typename Allocator>
+        auto collect(const Allocator& allocator) {
+            using ElementAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Element>;
+            Container<Element, ElementAllocator> container{ ElementAllocator(allocator) };
+            appendTo(container);
+            return container;
+        }
+
+        // replaces the contents of `container`, reusing its capacity
+        template<typename Container>
+        Container& collectInto(Container& container) {
+            container.clear();
+            return appendTo(container);
+        }
+
+        template<typename Container>
+        Container& appendTo(Container& container) {
+            reserve(container, saturatingAdd(container.size(), extractor.sizeHint().lower));
+            extractor.forEachWhile([&container](auto&& e) {
+                container.push_back(std::forward<decltype(e)>(e));
+                return true;
+            });
+            return container;
+        }
+
+        // aggregates the elements sharing a key: every group starts as a copy of `init` and
+        // `accumulate(aggregate, element)` returns its next value; call sortedByKey() on the result for
+        // a sorted vector of (key, aggregate) pairs
+        template<typename KeyFunction, typename Aggregate, typename Accumulate>
+        auto groupBy(KeyFunction&& key, Aggregate init, Accumulate&& accumulate) {
+            using Key = std::decay_t<decltype(key(std::declval<value_type&>()))>;
+            FlatHashMap<Key, Aggregate> groups;
+            // there are no more keys than elements, but usually far fewer: the table grows past a few pages
+            const SizeHint hint = extractor.sizeHint();
+            groups.reserve(std::min<size_t>(hint.upper ? *hint.upper : hint.lower, 4096));
+            extractor.forEachWhile([&groups, &key, &init, &accumulate](auto&& e) {
+                Aggregate& aggregate = groups.tryEmplace(key(e), init);
+                aggregate = accumulate(std::move(aggregate), e);
+                return true;
+            });
+            return groups;
+        }
+
+        template<typename KeyFunction>
+        auto countBy(KeyFunction&& key) {
+            return groupBy(std::forward<KeyFunction>(key), size_t{ 0 }, [](size_t count, auto&) { return count + 1; });
+        }
+
+        // runs every aggregator (see namespace aggregators) over the elements in one pass and returns them
+        template<typename... Aggregators>
+        std::tuple<Aggregators...> aggregate(Aggregators... aggregators) {
+            std::tuple<Aggregators...> state(std::move(aggregators)...);
+            extractor.forEachWhile([&state](auto&& e) {
+                addAll(state, e, std::index_sequence_for<Aggregators...>{});
+                return true;
+            });
+            return state;
+        }
+
+        // e.g. aggregate<Count, Min, Mean>(), every aggregator is instantiated for the element type
+        template<template<typename> class... Aggregators>
+        auto aggregate() {
+            return aggregate(Aggregators<std::remove_const_t<value_type>>()...);
+        }
+
+        template <typename Predicate, template<class...> class Container = std::vector, typename Element = std::remove_const_t<value_type>>
+        auto partition(Predicate&& predicate) {
+            std::pair<Container<Element>, Container<Element>> pair;
+            partitionInto(pair, predicate);
+            return pair;
+        }
+
+        template <typename Predicate, template<class...> class Container = std::vector, typename Element = std::remove_const_t<value_type>, typename Allocator>
+        auto partition(Predicate&& predicate, const Allocator& allocator) {
+            using ElementAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Element>;
+            using Part = Container<Element, ElementAllocator>;
+            std::pair<Part, Part> pair{ Part{ ElementAllocator(allocator) }, Part{ ElementAllocator(allocator) } };
+            partitionInto(pair, predicate);
+            return pair;
+        }
+
+    private:
+        // Terminal operations evaluated at compile time, they pull elements one by one
+
+        CONSTEXPR size_t countPulling() {
+            size_t counter = 0;
+            while (extractor.advance()) {
+                ++counter;
+            }
+            return counter;
+        }
+
+        template<typename Predicate>
+        CONSTEXPR bool anyPulling(Predicate& predicate) {
+            while (extractor.advance()) {
+                if (predicate(*extractor.get())) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        template<typename Predicate>
+        CONSTEXPR bool allPulling(Predicate& predicate) {
+            while (extractor.advance()) {
+                if (!predicate(*extractor.get())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template<typename Predicate>
+        CONSTEXPR Optional<std::remove_const_t<value_type>> findPulling(Predicate& predicate) {
+            while (extractor.advance()) {
+                auto&& e = *extractor.get();
+                if (predicate(e)) {
+                    return Optional<std::remove_const_t<value_type>>(e);
+                }
+            }
+            return nullopt;
+        }
+
+        template<typename Predicate>
+        CONSTEXPR Optional<size_t> positionPulling(Predicate& predicate) {
+            for (size_t counter = 1; extractor.advance(); ++counter) {
+                if (predicate(*extractor.get())) {
+                    return counter;
+                }
+            }
+            return nullopt;
+        }
+
+        template<typename Comparator>
+        CONSTEXPR Optional<std::remove_const_t<value_type>> minPulling(Comparator& cmp) {
+            if (!extractor.advance()) {
+                return nullopt;
+            }
+            std::remove_const_t<value_type> value = *extractor.get();
+            while (extractor.advance()) {
+                auto&& e = *extractor.get();
+                if (cmp(e, value)) {
+                    value = e;
+                }
+            }
+            return Optional<std::remove_const_t<value_type>>(value);
+        }
+
+        template<typename Accumulator, typename Fold>
+        CONSTEXPR Accumulator foldPulling(Accumulator a, Fold& fold) {
+            while (extractor.advance()) {
+                a = fold(a, *extractor.get());
+            }
+            return a;
+        }
+
+        template<size_t... I>
+        CONSTEXPR std::array<std::remove_const_t<value_type>, sizeof...(I)> collectArray(std::index_sequence<I...>) {
+            return{ { (static_cast<void>(I), nextOrDefault())... } };
+        }
+
+        CONSTEXPR std::remove_const_t<value_type> nextOrDefault() {
+            if (extractor.advance()) {
+                return *extractor.get();
+            }
+            return std::remove_const_t<value_type>{};
+        }
+
+        // constant time over random-access chains
+        size_t count(std::false_type) {
+            return extractor.advanceBy(std::numeric_limits<size_t>::max());
+        }
+
+        size_t count(std::true_type) {
+            return extractor.countBlocks();
+        }
+
+        // the elements stay in place, so only the last one is copied
+        Optional<std::remove_const_t<value_type>> last(std::true_type) {
+            const value_type* found = nullptr;
+            extractor.forEachWhile([&found](auto& e) {
+                found = &e;
+                return true;
+            });
+            return found ? Optional<std::remove_const_t<value_type>>(*found) : nullopt;
+        }
+
+        // advancing may overwrite the storage a previous element was in (e.g. a filter rejecting a mapped
+        // element), so every element is assigned to the result, moved when it is a temporary
+        Optional<std::remove_const_t<value_type>> last(std::false_type) {
+            Optional<std::remove_const_t<value_type>> value {};
+            extractor.forEachWhile([&value](auto&& e) {
+                value = std::forward<decltype(e)>(e);
+                return true;
+            });
+            return value;
+        }
+
+        template<typename Comparator>
+        Optional<std::remove_const_t<value_type>> min(Comparator& cmp, std::false_type) {
+            Optional<std::remove_const_t<value_type>> value {};
+            extractor.forEachWhile([&value, &cmp](auto&& e) {
+                if (!value || cmp(e, *value)) { // nullopt is the least
+                    value = std::forward<decltype(e)>(e);
+                }
+                return true;
+            });
+            return value;
+        }
+
+        // equal arithmetic values are indistinguishable, so whichever one the kernel finds will do
+        template<typename Comparator>
+        Optional<std::remove_const_t<value_type>> min(Comparator& cmp, std::true_type) {
+            Optional<std::remove_const_t<value_type>> value {};
+            extractor.forEachBlock([&value, &cmp](const auto* data, size_t size) {
+                const auto extremum = minOfBlock(data, size, cmp);
+                if (!value || cmp(extremum, *value)) {
+                    value = extremum;
+                }
+            });
+            return value;
+        }
+
+        template<typename T>
+        static T minOfBlock(const T* data, size_t size, const std::less<T>&) {
+            return simd::min(data, size);
+        }
+
+        template<typename T>
+        static T minOfBlock(const T* data, size_t size, const std::greater<T>&) {
+            return simd::max(data, size);
+        }
+
+        template<typename Accumulator, typename Fold>
+        Accumulator foldWith(Accumulator a, Fold& fold, std::false_type) {
+            extractor.forEachWhile([&a, &fold](auto&& e) {
+                a = fold(a, e);
+                return true;
+            });
+            return a;
+        }
+
+        template<typename Accumulator, typename Fold>
+        Accumulator foldWith(Accumulator a, Fold& fold, std::true_type) {
+            extractor.forEachBlock([&a, &fold](const auto* data, size_t size) {
+                using Value = std::remove_const_t<std::remove_reference_t<decltype(*data)>>;
+                a = foldBlock(std::move(a), fold, data, size, std::integral_constant<bool,
+                    traits::IsPlus<std::decay_t<Fold>, Value>::value && std::is_same<Accumulator, Value>::value>{});
+            });
+            return a;
+        }
+
+        template<typename Accumulator, typename Fold, typename T>
+        static Accumulator foldBlock(Accumulator a, Fold& fold, const T* data, size_t size, std::false_type) {
+            for (size_t i = 0; i < size; ++i) {
+                a = fold(a, data[i]);
+            }
+            return a;
+        }
+
+        // a plain sum is reassociated into vector lanes, floating point results may differ in the last bits
+        template<typename Accumulator, typename Fold, typename T>
+        static Accumulator foldBlock(Accumulator a, Fold&, const T* data, size_t size, std::true_type) {
+            return static_cast<Accumulator>(a + simd::sum(data, size));
+        }
+
+        template<typename Tuple, typename Element, size_t... I>
+        static void addAll(Tuple& aggregators, const Element& e, std::index_sequence<I...>) {
+            using Expand = int[];
+            (void)Expand{ 0, (std::get<I>(aggregators).add(e), 0)... };
+        }
+
+        template<typename Pair, typename Predicate>
+        void partitionInto(Pair& pair, Predicate& predicate) {
+            // the sides share the lower bound, so no more than the input is reserved; a side getting
+            // more than its share grows as usual
+            const size_t lower = extractor.sizeHint().lower;
+            reserve(pair.first, lower - lower / 2);
+            reserve(pair.second, lower / 2);
+            extractor.forEachWhile([&pair, &predicate](auto&& e) {
+                if (predicate(e)) {
+                    pair.first.push_back(std::forward<decltype(e)>(e));
+                } else {
+                    pair.second.push_back(std::forward<decltype(e)>(e));
+                }
+                return true;
+            });
+        }
+
+        template<typename Container>
+        static void reserve(Container& container, size_t size) {
+            reserve(container, size, traits::HasReserve<Container>{});
         }
 
-        bool advance_impl() {
-            if (firstHaveElements && (firstHaveElements = first.advance())) {
-                return true;
+        // grows geometrically, so appending to the same container again and again stays amortized
+        template<typename Container>
+        static void reserve(Container& container, size_t size, std::true_type) {
+            if (container.capacity() < size) {
+                container.reserve(std::max(size, 2 * container.capacity()));
             }
-            return next.advance();
         }
 
+        template<typename Container>
+        static void reserve(Container&, size_t, std::false_type) {}
     };
 
+    // Splits the source into one part per thread and runs the whole adaptor chain on each part
+    // independently. Callables are invoked concurrently, so they have to be thread safe.
+    template<typename ExtractorType>
+    struct ParallelStreamInterface {
+        ExtractorType extractor;
+        size_t threads;
+        using value_type = typename BaseStreamInterface<ExtractorType>::value_type;
 
-    template<typename ExtractorType, typename ExtractorOtherType>
-    struct ZipStreamExtractor : StreamExtractor<ZipStreamExtractor<ExtractorType, ExtractorOtherType>> {
-        ZipStreamExtractor(ExtractorType extractor, ExtractorOtherType other) : left(extractor), right(other) {}
-
-        ExtractorType left;
-        ExtractorOtherType right;
-        std::tuple<traits::ValueType<ExtractorType>, traits::ValueType<ExtractorOtherType>> value {};
+        ParallelStreamInterface(ExtractorType e, size_t threads) : extractor(e), threads(threads) {
+            if (this->threads == 0) {
+                this->threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+        }
 
-        auto get_impl() {
-            value = std::make_tuple(*left.get(), *right.get());
-            return &value;
+        // `fold` reduces every part starting from `identity`, `combine` merges partial results in source order
+        template<typename Accumulator, typename Fold, typename Combine>
+        Accumulator fold(Accumulator identity, Fold&& fold, Combine&& combine) {
+            auto parts = run<Accumulator>([&identity, &fold](auto stream) {
+                return stream.fold(identity, fold);
+            });
+            Accumulator result = std::move(*parts.front());
+            for (size_t i = 1; i < parts.size(); ++i) {
+                result = combine(std::move(result), std::move(*parts[i]));
+            }
+            return result;
         }
 
-        bool advance_impl() {
-            return left.advance() && right.advance();
+        template<typename Callable>
+        void forEach(Callable&& callable) {
+            run<bool>([&callable](auto stream) {
+                stream.forEach(callable);
+                return true;
+            });
         }
 
-    };
+        size_t count() {
+            return fold(size_t{0}, [](size_t c, auto&&) { return c + 1; }, std::plus<size_t>{});
+        }
 
+        template<typename Comparator = std::less<std::remove_const_t<value_type>>>
+        Optional<std::remove_const_t<value_type>> min(Comparator cmp = {}) {
+            auto parts = run<Optional<std::remove_const_t<value_type>>>([&cmp](auto stream) {
+                return stream.min(cmp);
+            });
+            Optional<std::remove_const_t<value_type>> value {};
+            for (auto& part : parts) {
+                if (*part && (!value || cmp(**part, *value))) {
+                    value = std::move(*part);
+                }
+            }
+            return value;
+        }
 
-    template<typename ExtractorType>
-    struct PurifyStreamExtractor : StreamExtractor<PurifyStreamExtractor<ExtractorType>> {
-        PurifyStreamExtractor(ExtractorType extractor) : source(extractor), value() {}
+        template<typename Comparator = std::greater<std::remove_const_t<value_type>>>
+        Optional<std::remove_const_t<value_type>> max(Comparator cmp = {}) {
+            return min(cmp);
+        }
 
-        ExtractorType source;
-        using source_optional_type = traits::ValueType<ExtractorType>;
-        static_assert(traits::IsOptional<source_optional_type>(), "Expected Optional<T> as a source");
-        using value_type = std::remove_const_t<typename source_optional_type::value_type>;
-        value_type value;
+        // every part is aggregated separately, then partial results are merged in source order
+        template<typename... Aggregators>
+        std::tuple<Aggregators...> aggregate(Aggregators... initial) {
+            using State = std::tuple<Aggregators...>;
+            auto parts = run<State>([&initial...](auto stream) {
+                return stream.aggregate(initial...);
+            });
+            State result = std::move(*parts.front());
+            for (size_t i = 1; i < parts.size(); ++i) {
+                aggregators::mergeAll(result, *parts[i], std::index_sequence_for<Aggregators...>{});
+            }
+            return result;
+        }
 
-        auto get_impl() {
-            value = **source.get();
-            return &value;
+        template<template<typename> class... Aggregators>
+        auto aggregate() {
+            return aggregate(Aggregators<std::remove_const_t<value_type>>()...);
         }
 
-        bool advance_impl() {
-            while (source.advance()) {
-                if (*source.get() != nullopt) {
-                    return true;
+    private:
+        // runs job(stream) over every part, the calling thread takes the first one and the parts no thread
+        // could be started for
+        template<typename Result, typename Job>
+        std::vector<Optional<Result>> run(Job&& job) {
+            const size_t size = extractor.splitSize();
+            const size_t partsCount = std::max<size_t>(1, std::min(threads, size));
+
+            std::vector<Optional<Result>> results(partsCount);
+            std::vector<std::exception_ptr> errors(partsCount);
+            std::vector<std::thread> workers;
+            workers.reserve(partsCount - 1);
+
+            auto runPart = [this, &job, &results, &errors, size, partsCount](size_t i) {
+                try {
+                    auto part = extractor.split(size * i / partsCount, size * (i + 1) / partsCount);
+                    results[i] = job(BaseStreamInterface<decltype(part)>(part));
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            };
+
+            size_t started = 1;
+            try {
+                for (; started < partsCount; ++started) {
+                    workers.emplace_back(runPart, started);
                 }
+            } catch (...) {}
+            runPart(0);
+            for (size_t i = started; i < partsCount; ++i) {
+                runPart(i);
             }
-            return false;
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            for (auto& error : errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+            return results;
         }
-
     };
 
-    template<typename ExtractorType>
-    struct BaseStreamInterface {
-        ExtractorType extractor;
-        using value_type = std::remove_reference_t<decltype(*extractor.get())>;
+    // Lazily merges streams sorted according to `compare` into one sorted stream (see MergeStreamExtractor)
+    template<typename Compare, typename... ExtractorTypes>
+    auto merge(Compare&& compare, BaseStreamInterface<ExtractorTypes>... streams) {
+        using Sources = std::tuple<ExtractorTypes...>;
+        using Extractor = MergeStreamExtractor<Sources, Compare>;
+        static_assert(sizeof...(ExtractorTypes) > 0, "merge() needs a stream");
+        static_assert(traits::AllSame<traits::ValueType<ExtractorTypes>...>::value, "merged streams must have the same element type");
+        return BaseStreamInterface<Extractor>(Extractor(Sources(streams.extractor...), std::forward<Compare>(compare)));
+    }
 
-        CONSTEXPR BaseStreamInterface(ExtractorType e) : extractor(e) {}
+    // the same for a number of streams known at run time, use AnyStream for streams of different types
+    template<typename Compare, typename Stream>
+    auto merge(Compare&& compare, const std::vector<Stream>& streams) {
+        using Sources = std::vector<std::decay_t<decltype(std::declval<const Stream&>().extractor)>>;
+        using Extractor = MergeStreamExtractor<Sources, Compare>;
+        Sources sources;
+        sources.reserve(streams.size());
+        for (auto& stream : streams) {
+            sources.push_back(stream.extractor);
+        }
+        return BaseStreamInterface<Extractor>(Extractor(std::move(sources), std::forward<Compare>(compare)));
+    }
 
-        // Intermediate Operations
+    // The virtual interface of an extractor erased by AnyStream: elements are pulled in batches, so one
+    // virtual call is spread over many elements
+    template<typename T>
+    struct AnyExtractorConcept {
+        virtual ~AnyExtractorConcept() = default;
+
+        // constructs up to `count` elements in the raw storage at `batch`, fewer only when the stream is
+        // depleted; `size` counts the ones constructed so far, so they can be destroyed if one throws
+        virtual void pull(void* batch, size_t count, size_t& size) = 0;
+        virtual SizeHint sizeHint() const = 0;
+        // copies or moves the extractor into `buffer` if it fits there, onto the heap otherwise
+        virtual AnyExtractorConcept* copyTo(void* buffer, size_t size) const = 0;
+        virtual AnyExtractorConcept* moveTo(void* buffer, size_t size) = 0;
+    };
 
-        template<typename Transform>
-        auto map(Transform&& transform) {
-            using Extractor = MapStreamExtractor<decltype(extractor), Transform>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Transform>(transform)));
-        }
+    template<typename T, typename ExtractorType>
+    struct AnyExtractorModel final : AnyExtractorConcept<T> {
+        explicit AnyExtractorModel(ExtractorType extractor) : extractor(std::move(extractor)) {}
 
-        // expects that std::begin and std::end can be called on the result of transform
-        template<typename Transform>
-        auto flatMap(Transform&& transform) {
-            using Extractor = FlatMapStreamExtractor<decltype(extractor), Transform>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Transform>(transform)));
-        }
+        ExtractorType extractor;
 
-        // add flatten level
-        auto flatten() {
-            const auto flat = [](auto&& e) { return e; };
-            using Extractor = FlatMapStreamExtractor<decltype(extractor), decltype(flat)>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, std::move(flat)));
+        static bool fits(size_t size) {
+            return sizeof(AnyExtractorModel) <= size && alignof(AnyExtractorModel) <= alignof(std::max_align_t);
         }
 
-        template<typename Predicate>
-        auto filter(Predicate&& predicate) {
-            using Extractor = FilterStreamExtractor<decltype(extractor), Predicate>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Predicate>(predicate)));
+        void pull(void* batch, size_t count, size_t& size) override {
+            if (count != 0) {
+                T* items = static_cast<T*>(batch);
+                extractor.forEachWhile([items, &size, count](auto&& e) {
+                    new (items + size) T(std::forward<decltype(e)>(e));
+                    return ++size != count;
+                });
+            }
         }
 
-        template<typename Transform>
-        auto filterMap(Transform&& transform) {
-            using Extractor = FilterMapStreamExtractor<decltype(extractor), Transform>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Transform>(transform)));
+        SizeHint sizeHint() const override {
+            return extractor.sizeHint();
         }
 
-        auto skip(size_t count) {
-            using Extractor = SkipFirstStreamExtractor<decltype(extractor)>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, count));
+        AnyExtractorConcept<T>* copyTo(void* buffer, size_t size) const override {
+            return fits(size) ? new (buffer) AnyExtractorModel(*this) : new AnyExtractorModel(*this);
         }
 
-        template<typename Predicate>
-        auto skipWhile(Predicate&& predicate) {
-            using Extractor = SkipWhileStreamExtractor<decltype(extractor), Predicate>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Predicate>(predicate)));
+        AnyExtractorConcept<T>* moveTo(void* buffer, size_t size) override {
+            return fits(size) ? new (buffer) AnyExtractorModel(std::move(*this)) : new AnyExtractorModel(std::move(*this));
         }
+    };
 
-        auto take(size_t count) {
-            using Extractor = TakeStreamExtractor<decltype(extractor)>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, count));
+    // Holds any extractor of elements convertible to T, in place when it takes up to BufferSize bytes and
+    // on the heap otherwise. Elements are copied into a batch of `batchSize` (at most BatchCapacity) pulled
+    // at a time, so side effects upstream run up to a batch ahead. The batch is stored in place too, so
+    // nothing but an extractor too large for BufferSize is allocated. A moved-from extractor is empty.
+    template<typename T, size_t BufferSize = 128, size_t BatchCapacity = 16>
+    struct AnyStreamExtractor : StreamExtractor<AnyStreamExtractor<T, BufferSize, BatchCapacity>> {
+        static_assert(BatchCapacity != 0, "a batch holds at least one element");
+        using Concept = AnyExtractorConcept<T>;
+
+        template<typename ExtractorType>
+        AnyStreamExtractor(ExtractorType extractor, size_t batchSize)
+            : storage(), model(AnyExtractorModel<T, ExtractorType>(std::move(extractor)).moveTo(&storage, BufferSize))
+            , items(), size(0), position(0), batchSize(std::min(std::max<size_t>(batchSize, 1), BatchCapacity)) {}
+
+        AnyStreamExtractor(const AnyStreamExtractor& other)
+            : storage(), model(other.model ? other.model->copyTo(&storage, BufferSize) : nullptr)
+            , items(), size(0), position(other.position), batchSize(other.batchSize) {
+            try {
+                copyItems(other);
+            } catch (...) {
+                reset();
+                throw;
+            }
         }
 
-        template<typename Predicate>
-        auto takeWhile(Predicate&& predicate) {
-            using Extractor = TakeWhileStreamExtractor<decltype(extractor), Predicate>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Predicate>(predicate)));
+        AnyStreamExtractor(AnyStreamExtractor&& other)
+            : storage(), model(other.take(&storage)), items(), size(0), position(0), batchSize(other.batchSize) {
+            moveItems(other);
         }
 
-        template<typename Inspector>
-        auto inspect(Inspector&& inspector) {
-            using Extractor = InspectStreamExtractor<decltype(extractor), Inspector>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Inspector>(inspector)));
+        AnyStreamExtractor& operator = (const AnyStreamExtractor& other) {
+            if (this != &other) {
+                reset();
+                model = other.model ? other.model->copyTo(&storage, BufferSize) : nullptr;
+                batchSize = other.batchSize;
+                copyItems(other);
+            }
+            return *this;
         }
 
-        template<typename Inspector>
-        auto spy(Inspector&& inspector) {
-            using Extractor = SpyStreamExtractor<decltype(extractor), Inspector>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, std::forward<Inspector>(inspector)));
+        AnyStreamExtractor& operator = (AnyStreamExtractor&& other) {
+            if (this != &other) {
+                reset();
+                model = other.take(&storage);
+                batchSize = other.batchSize;
+                moveItems(other);
+            }
+            return *this;
         }
 
-        auto enumerate(size_t from = 0) {
-            using Extractor = EnumerateStreamExtractor<decltype(extractor)>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, from));
+        ~AnyStreamExtractor() {
+            reset();
         }
 
-        auto enumerateTup(size_t from = 0) {
-            using Extractor = EnumerateTupleStreamExtractor<decltype(extractor)>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, from));
-        }
+        std::aligned_storage_t<BufferSize, alignof(std::max_align_t)> storage;
+        Concept* model;         // points into `storage` or to the heap
+        std::aligned_storage_t<sizeof(T), alignof(T)> items[BatchCapacity];
+        size_t size;            // elements constructed in `items`
+        size_t position;        // one past the current element in `items`
+        size_t batchSize;
 
-        template <template<typename> class StreamOther, typename OtherExtractor>
-        auto chain(StreamOther<OtherExtractor> other) {
-            using Extractor = ChainStreamExtractor<decltype(extractor), OtherExtractor>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, other.extractor));
+        T* batch() {
+            return reinterpret_cast<T*>(items);
         }
 
-        template <template<typename> class StreamOther, typename OtherExtractor>
-        auto zip(StreamOther<OtherExtractor> other) {
-            using Extractor = ZipStreamExtractor<decltype(extractor), OtherExtractor>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor, other.extractor));
+        SizeHint sizeHint_impl() const {
+            const SizeHint buffered = SizeHint::exactly(size - position);
+            return model ? model->sizeHint() + buffered : buffered;
         }
 
-        auto purify() {
-            static_assert(traits::IsOptional<value_type>(), "Purify should be called on a stream of Optional<T> values");
-            using Extractor = PurifyStreamExtractor<decltype(extractor)>;
-            return BaseStreamInterface<Extractor>(Extractor(extractor));
+        auto get_impl() {
+            return batch() + (position - 1);
         }
 
-        // Non-Terminal
-
-        Optional<value_type> next() {
-            if (extractor.advance()) {
-                return{ *extractor.get() };
+        bool advance_impl() {
+            if (position == size) {
+                clear();
+                if (!model) {
+                    return false;
+                }
+                model->pull(items, batchSize, size);
+                if (size == 0) {
+                    return false;
+                }
             }
-            return{};
+            ++position;
+            return true;
         }
 
-        Optional<value_type> nth(size_t n) {
-            while (n && extractor.advance()) {
-                --n;
-            }
-            return next();
+        // elements held in place rather than on the heap
+        bool local() const {
+            return static_cast<const void*>(model) == static_cast<const void*>(&storage);
         }
-        // Terminal Operations 
 
-        Optional<value_type> last() {
-            if (!extractor.advance()) {
-                return nullopt;
-            } else {
-                auto ptr = extractor.get();
-                while (extractor.advance()) {
-                    ptr = extractor.get();
-                }				
-                return *ptr;			
+    private:
+        // moves the model of this extractor to `buffer` or hands over its heap copy
+        Concept* take(void* buffer) {
+            Concept* taken = model;
+            if (model && local()) {
+                taken = model->moveTo(buffer, BufferSize);
+                model->~Concept();
             }
+            model = nullptr;
+            return taken;
         }
 
-        template<typename Callable>
-        void forEach(Callable&& callable) {
-            while (extractor.advance()) {
-                callable(*extractor.get());
+        void reset() {
+            clear();
+            if (model && local()) {
+                model->~Concept();
+            } else {
+                delete model;
             }
+            model = nullptr;
         }
 
-        size_t count() {
-            size_t counter = 0;
-            while (extractor.advance()) {
-                ++counter;
+        // destroys the elements of the batch
+        void clear() {
+            for (size_t i = 0; i < size; ++i) {
+                batch()[i].~T();
             }
-            return counter;
+            size = 0;
+            position = 0;
         }
 
-        template<typename Predicate>
-        bool any(Predicate&& predicate) {
-            while (extractor.advance()) {
-                if (predicate(*extractor.get())) {
-                    return true;
-                }
+        void copyItems(const AnyStreamExtractor& other) {
+            clear();
+            const T* source = reinterpret_cast<const T*>(other.items);
+            for (; size < other.size; ++size) {
+                new (batch() + size) T(source[size]);
             }
-            return false;
+            position = other.position;
         }
 
-        template<typename Predicate>
-        bool all(Predicate&& predicate) {
-            while (extractor.advance()) {
-                if (!predicate(*extractor.get())) {
-                    return false;
-                }
+        void moveItems(AnyStreamExtractor& other) {
+            clear();
+            for (; size < other.size; ++size) {
+                new (batch() + size) T(std::move(other.batch()[size]));
             }
-            return true;
+            position = other.position;
+            other.clear();
         }
+    };
 
-        template<typename Comparator = std::less<std::remove_const_t<value_type>>>
-        Optional<std::remove_const_t<value_type>> min(Comparator cmp = {}) {
-            Optional<std::remove_const_t<value_type>> value {};
-            while (extractor.advance()) {
-                auto v = extractor.get();
-                if (!value || cmp(*v, *value)) { // nullopt is the least
-                    value = *v;
-                }
+    // A stream of T that can hold any stream of elements convertible to T, so pipelines can be returned
+    // from functions, stored as members or picked at run time. See AnyStreamExtractor. Both the batch of
+    // up to BatchCapacity elements and an extractor of up to BufferSize bytes (a few stages over a
+    // collection) are stored in the stream, so every copy or move of the stream copies them: a larger
+    // BufferSize keeps bigger pipelines off the heap, a larger BatchCapacity spreads a virtual call over
+    // more elements, both at the cost of a larger stream.
+    template<typename T, size_t BatchCapacity = 16, size_t BufferSize = 128>
+    struct AnyStream : BaseStreamInterface<AnyStreamExtractor<T, BufferSize, BatchCapacity>> {
+        static constexpr size_t defaultBatchSize = BatchCapacity;
+
+        template<typename ExtractorType>
+        AnyStream(BaseStreamInterface<ExtractorType> stream, size_t batchSize = defaultBatchSize)
+            : BaseStreamInterface<AnyStreamExtractor<T, BufferSize, BatchCapacity>>(AnyStreamExtractor<T, BufferSize, BatchCapacity>(std::move(stream.extractor), batchSize)) {}
+    };
+
+    template<typename T, size_t BatchCapacity, size_t BufferSize>
+    constexpr size_t AnyStream<T, BatchCapacity, BufferSize>::defaultBatchSize;
+
+    template<typename Container>
+    CONSTEXPR auto from(const Container& container) {
+        using Extractor = SequenceStreamExtractor<decltype(std::begin(container))>;
+        return BaseStreamInterface<Extractor>(Extractor(std::begin(container), std::end(container)));
+    }
+
+    // takes ownership of a temporary collection, copies of the stream share it
+    template<typename Container, typename = std::enable_if_t<!std::is_lvalue_reference<Container>::value>>
+    auto from(Container&& container) {
+        using Extractor = SharedSequenceStreamExtractor<std::remove_const_t<Container>>;
+        return BaseStreamInterface<Extractor>(Extractor(std::make_shared<const std::remove_const_t<Container>>(std::move(container))));
+    }
+
+    // Views of the pieces of a text between delimiters, found with memchr. In line mode a '\r' before the
+    // delimiter is dropped and a delimiter at the very end doesn't start one more, empty, piece. `storage`
+    // keeps the text alive when the stream owns it.
+    struct SplitStreamExtractor : StreamExtractor<SplitStreamExtractor> {
+        SplitStreamExtractor(StringView text, char delimiter, bool lines, std::shared_ptr<const void> storage = nullptr)
+            : rest(text), delimiter(delimiter), lines(lines), storage(std::move(storage)), value() {}
+
+        StringView rest;        // the text after the last piece
+        char delimiter;
+        bool lines;
+        std::shared_ptr<const void> storage;
+        StringView value;
+        bool done = false;
+
+        SizeHint sizeHint_impl() const {
+            if (done || (lines && rest.empty())) {
+                return SizeHint::exactly(0);
             }
-            return value;
+            // there is one more piece than delimiters left
+            return{ 1, rest.size() + 1 };
         }
 
-        template<typename Comparator = std::greater<std::remove_const_t<value_type>>>
-        Optional<std::remove_const_t<value_type>> max(Comparator cmp = {}) {
-            return min(cmp);
+        auto get_impl() {
+            return &value;
         }
 
-        template<typename Predicate>
-        Optional<std::remove_const_t<value_type>> find(Predicate&& predicate) {
-            while (extractor.advance()) {
-                auto e = extractor.get();
-                if (predicate(*e)) {
-                    return *e;
-                }
+        bool advance_impl() {
+            if (done || (lines && rest.empty())) {
+                done = true;
+                return false;
             }
-            return nullopt;
+            const void* found = rest.empty() ? nullptr : std::memchr(rest.data(), delimiter, rest.size());
+            const size_t length = found ? static_cast<size_t>(static_cast<const char*>(found) - rest.data()) : rest.size();
+            value = rest.substr(0, length);
+            if (lines && !value.empty() && value.back() == '\r') {
+                value.remove_suffix(1);
+            }
+            rest.remove_prefix(found ? length + 1 : length);
+            done = !found;
+            return true;
         }
+    };
 
-        template<typename Predicate>
-        Optional<size_t> position(Predicate&& predicate) {
-            size_t counter = 0;
-            while (extractor.advance()) {
-                ++counter;
-                if (predicate(*extractor.get())) {
-                    return counter;
+    // the pieces of `text` between delimiters, an empty text is a single empty piece
+    inline auto split(StringView text, char delimiter) {
+        return BaseStreamInterface<SplitStreamExtractor>(SplitStreamExtractor(text, delimiter, false));
+    }
+
+    // the lines of `text` without line breaks ("\n" or "\r\n")
+    inline auto lines(StringView text) {
+        return BaseStreamInterface<SplitStreamExtractor>(SplitStreamExtractor(text, '\n', true));
+    }
+
+    // a temporary std::string is kept by the stream
+    template<typename String, typename = std::enable_if_t<std::is_same<String, std::string>::value>>
+    auto split(String&& text, char delimiter) {
+        auto owned = std::make_shared<const std::string>(std::move(text));
+        return BaseStreamInterface<SplitStreamExtractor>(SplitStreamExtractor(*owned, delimiter, false, owned));
+    }
+
+    template<typename String, typename = std::enable_if_t<std::is_same<String, std::string>::value>>
+    auto lines(String&& text) {
+        auto owned = std::make_shared<const std::string>(std::move(text));
+        return BaseStreamInterface<SplitStreamExtractor>(SplitStreamExtractor(*owned, '\n', true, owned));
+    }
+
+#ifdef STREAMS_HAS_MMAP
+    // A read-only mapping of a file of records of type T, unmapped when the last stream over it is gone.
+    // A trailing partial record is ignored.
+    template<typename T>
+    struct MappedFile {
+        static_assert(std::is_trivially_copyable<T>::value, "a mapped file can only hold trivially copyable records");
+
+        explicit MappedFile(const std::string& path) : records(nullptr), bytes(0) {
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), "open " + path);
+            }
+            struct stat status;
+            if (::fstat(fd, &status) != 0) {
+                const int error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), "fstat " + path);
+            }
+            bytes = static_cast<size_t>(status.st_size);
+            if (bytes != 0) {
+                void* address = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (address == MAP_FAILED) {
+                    const int error = errno;
+                    ::close(fd);
+                    throw std::system_error(error, std::generic_category(), "mmap " + path);
                 }
+                ::madvise(address, bytes, MADV_SEQUENTIAL);
+                records = static_cast<const T*>(address);
             }
-            return nullopt;
+            ::close(fd);
         }
 
-        template<typename Accumulator, typename Fold>
-        Accumulator fold(Accumulator a, Fold&& fold) {
-            while (extractor.advance()) {
-                a = fold(a, *extractor.get());
-            }
-            return a;
-        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator = (const MappedFile&) = delete;
 
-        template <template<class...> class Container = std::vector, typename Element = std::remove_const_t<value_type>>
-        auto collect() {
-            Container<Element> container;
-            while (extractor.advance()) {
-                container.push_back(*extractor.get());
+        ~MappedFile() {
+            if (bytes != 0) {
+                ::munmap(const_cast<T*>(records), bytes);
             }
-            return container;
         }
 
-        template <typename Predicate, template<class...> class Container = std::vector, typename Element = std::remove_const_t<value_type>>
-        auto partition(Predicate&& predicate) {
-            std::pair<Container<Element>, Container<Element>> pair;
-            while (extractor.advance()) {
-                auto e = extractor.get();
-                if (predicate(*e)) {
-                    pair.first.push_back(*e);
-                } else {
-                    pair.second.push_back(*e);
-                }
-            }
-            return pair;
-        }
+        const T* begin() const { return records; }
+        const T* end() const { return records + bytes / sizeof(T); }
+        size_t size() const { return bytes / sizeof(T); }
 
+    private:
+        const T* records;
+        size_t bytes;
     };
 
-    template<typename Container>
-    auto from(const Container& container) {
-        using Extractor = SequenceStreamExtractor<decltype(std::begin(container))>;
-        return BaseStreamInterface<Extractor>(Extractor(std::begin(container), std::end(container)));
+    // streams the records of a binary file in place; throws std::system_error if it can't be mapped
+    template<typename T>
+    auto fromMappedFile(const std::string& path) {
+        using Extractor = SharedSequenceStreamExtractor<MappedFile<T>>;
+        return BaseStreamInterface<Extractor>(Extractor(std::make_shared<const MappedFile<T>>(path)));
     }
 
-    template<typename Container>
-    auto from(const Container&& container) = delete; // currently disastrous
+    // the lines of a text file, as views into its mapping
+    inline auto linesFromFile(const std::string& path) {
+        auto file = std::make_shared<const MappedFile<char>>(path);
+        return BaseStreamInterface<SplitStreamExtractor>(SplitStreamExtractor(StringView(file->begin(), file->size()), '\n', true, file));
+    }
+#endif
 
     inline namespace generators {
         struct CounterGenerator : StreamExtractor<CounterGenerator> {
@@ -701,14 +4833,31 @@ namespace streams {
 
             size_t current;
 
-            auto get_impl() noexcept {
+            static constexpr bool randomAccess = true;
+
+            CONSTEXPR auto get_impl() noexcept {
                 return &current;
             }
 
-            bool advance_impl() noexcept {
+            SizeHint sizeHint_impl() const noexcept {
+                return{ std::numeric_limits<size_t>::max(), nullopt };
+            }
+
+            CONSTEXPR bool advance_impl() noexcept {
                 current++;
                 return true;
             }
+
+            CONSTEXPR size_t advanceBy_impl(size_t count) noexcept {
+                current += count;
+                return count;
+            }
+
+            template<typename Sink>
+            bool forEachWhile_impl(Sink&& sink) {
+                while (sink(++current)) {}
+                return false;
+            }
         };
 
     } // namespace generators
@@ -723,4 +4872,20 @@ namespace streams {
 
 } // namespace streams
 
+#if defined _MSC_VER && !defined STREAMS_HAS_STD_STRING_VIEW
+namespace std {
+    template<>
+    struct hash<streams::StringView> {
+        size_t operator()(streams::StringView view) const noexcept {
+            const bool wide = sizeof(size_t) == 8; // FNV-1a
+            size_t result = wide ? static_cast<size_t>(14695981039346656037ull) : size_t(2166136261u);
+            for (char c : view) {
+                result = (result ^ static_cast<unsigned char>(c)) * (wide ? static_cast<size_t>(1099511628211ull) : size_t(16777619u));
+            }
+            return result;
+        }
+    };
+}
+#endif
+
 #endif // !RUST_STREAMS_H
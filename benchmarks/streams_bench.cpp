@@ -0,0 +1,414 @@
+// Measures the cost of stream pipelines against the equivalent hand-written loop and <algorithm> call.
+//
+//   streams_bench [--filter=<substring>] [--min-time=<seconds>] [--out=<file.json>]
+//
+// Every case runs three variants ("stream", "loop", "algorithm") over several input sizes and reports
+// nanoseconds per input element. Results are written as JSON (to stdout unless --out is given), a
+// human readable table goes to stderr.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../Streams.h"
+
+namespace {
+    // keeps the optimizer from discarding the measured computation
+    template<typename T>
+    void doNotOptimize(const T& value) {
+#if defined __GNUC__ || defined __clang__
+        __asm__ __volatile__("" : : "g"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+    struct Result {
+        std::string name;
+        std::string variant;
+        size_t size;
+        size_t iterations;
+        double nsPerIteration;
+    };
+
+    struct Options {
+        std::string filter {};
+        double minTime = 0.05;
+        std::string out {};
+    };
+
+    class Runner {
+    public:
+        explicit Runner(Options opts) : options(std::move(opts)), results() {}
+
+        template<typename Body>
+        void run(const std::string& name, const std::string& variant, size_t size, Body&& body) {
+            const std::string fullName = name + "/" + variant + "/" + std::to_string(size);
+            if (fullName.find(options.filter) == std::string::npos) {
+                return;
+            }
+
+            using Clock = std::chrono::steady_clock;
+            body(); // warm up caches and the allocator
+            size_t iterations = 1;
+            double elapsed = 0;
+            for (;;) {
+                const auto start = Clock::now();
+                for (size_t i = 0; i < iterations; ++i) {
+                    body();
+                }
+                elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+                if (elapsed >= options.minTime * 1e9 || iterations >= (size_t{1} << 30)) {
+                    break;
+                }
+                iterations *= 2;
+            }
+            results.push_back({ name, variant, size, iterations, elapsed / static_cast<double>(iterations) });
+
+            const Result& r = results.back();
+            std::fprintf(stderr, "%-36s %12.1f ns %10.3f ns/element\n", fullName.c_str(), r.nsPerIteration,
+                         r.nsPerIteration / static_cast<double>(std::max<size_t>(size, 1)));
+        }
+
+        void report() const {
+            std::ofstream file;
+            if (!options.out.empty()) {
+                file.open(options.out);
+            }
+            std::ostream& os = options.out.empty() ? std::cout : file;
+
+            os << "{\n  \"context\": {\n";
+            os << "    \"library\": \"Streams++\",\n";
+#if defined __VERSION__
+            os << "    \"compiler\": \"" << __VERSION__ << "\",\n";
+#endif
+#if defined __AVX2__
+            os << "    \"simd\": \"avx2\",\n";
+#elif defined __SSE2__
+            os << "    \"simd\": \"sse2\",\n";
+#else
+            os << "    \"simd\": \"none\",\n";
+#endif
+            os << "    \"min_time_s\": " << options.minTime << "\n  },\n";
+            os << "  \"benchmarks\": [\n";
+            for (size_t i = 0; i < results.size(); ++i) {
+                const Result& r = results[i];
+                os << "    {\"name\": \"" << r.name << "/" << r.variant << "/" << r.size << "\""
+                   << ", \"case\": \"" << r.name << "\""
+                   << ", \"variant\": \"" << r.variant << "\""
+                   << ", \"size\": " << r.size
+                   << ", \"iterations\": " << r.iterations
+                   << ", \"ns_per_iteration\": " << r.nsPerIteration
+                   << ", \"ns_per_element\": " << r.nsPerIteration / static_cast<double>(std::max<size_t>(r.size, 1))
+                   << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+            }
+            os << "  ]\n}\n";
+        }
+
+    private:
+        Options options;
+        std::vector<Result> results;
+    };
+
+    // values below 1000 keep int sums of up to 2M elements in range; sums of squares and products
+    // are accumulated as long long
+    std::vector<int> makeData(size_t size) {
+        std::vector<int> data(size);
+        unsigned state = 12345;
+        for (auto& e : data) {
+            state = state * 1103515245u + 12345u;
+            e = static_cast<int>((state >> 16) % 1000);
+        }
+        return data;
+    }
+
+    void benchmarkAdaptors(Runner& runner, size_t size) {
+        const std::vector<int> data = makeData(size);
+        const std::vector<int> other = makeData(size + 1);
+
+        runner.run("map", "stream", size, [&] {
+            doNotOptimize(streams::from(data).map([](auto& e) { return static_cast<long long>(e) * e; }).fold(0LL, std::plus<>()));
+        });
+        runner.run("map", "loop", size, [&] {
+            long long sum = 0;
+            for (int e : data) {
+                sum += static_cast<long long>(e) * e;
+            }
+            doNotOptimize(sum);
+        });
+        runner.run("map", "algorithm", size, [&] {
+            doNotOptimize(std::accumulate(data.begin(), data.end(), 0LL, [](long long a, int e) { return a + static_cast<long long>(e) * e; }));
+        });
+
+        runner.run("filter", "stream", size, [&] {
+            doNotOptimize(streams::from(data).filter([](auto& e) { return e % 2 == 0; }).count());
+        });
+        runner.run("filter", "loop", size, [&] {
+            size_t count = 0;
+            for (int e : data) {
+                if (e % 2 == 0) {
+                    ++count;
+                }
+            }
+            doNotOptimize(count);
+        });
+        runner.run("filter", "algorithm", size, [&] {
+            doNotOptimize(std::count_if(data.begin(), data.end(), [](int e) { return e % 2 == 0; }));
+        });
+
+        runner.run("filterMap", "stream", size, [&] {
+            doNotOptimize(streams::from(data)
+                .filterMap([](auto& e) { return e % 3 == 0 ? streams::Optional<int>(e * 2) : streams::nullopt; })
+                .fold(0, std::plus<>()));
+        });
+        runner.run("filterMap", "loop", size, [&] {
+            int sum = 0;
+            for (int e : data) {
+                if (e % 3 == 0) {
+                    sum += e * 2;
+                }
+            }
+            doNotOptimize(sum);
+        });
+        runner.run("filterMap", "algorithm", size, [&] {
+            doNotOptimize(std::accumulate(data.begin(), data.end(), 0, [](int a, int e) { return e % 3 == 0 ? a + e * 2 : a; }));
+        });
+
+        std::vector<std::vector<int>> rows;
+        for (size_t i = 0; i < size; i += 16) {
+            rows.emplace_back(data.begin() + static_cast<std::ptrdiff_t>(i), data.begin() + static_cast<std::ptrdiff_t>(std::min(size, i + 16)));
+        }
+        runner.run("flatMap", "stream", size, [&] {
+            doNotOptimize(streams::from(rows).flatten().fold(0, std::plus<>()));
+        });
+        runner.run("flatMap", "loop", size, [&] {
+            int sum = 0;
+            for (auto& row : rows) {
+                for (int e : row) {
+                    sum += e;
+                }
+            }
+            doNotOptimize(sum);
+        });
+        runner.run("flatMap", "algorithm", size, [&] {
+            doNotOptimize(std::accumulate(rows.begin(), rows.end(), 0, [](int a, const std::vector<int>& row) {
+                return std::accumulate(row.begin(), row.end(), a);
+            }));
+        });
+
+        runner.run("zip", "stream", size, [&] {
+            doNotOptimize(streams::from(data).zip(streams::from(other))
+                .fold(0LL, [](long long a, auto& t) { return a + static_cast<long long>(std::get<0>(t)) * std::get<1>(t); }));
+        });
+        runner.run("zip", "loop", size, [&] {
+            long long sum = 0;
+            for (size_t i = 0; i < size; ++i) {
+                sum += static_cast<long long>(data[i]) * other[i];
+            }
+            doNotOptimize(sum);
+        });
+        runner.run("zip", "algorithm", size, [&] {
+            doNotOptimize(std::inner_product(data.begin(), data.end(), other.begin(), 0LL, std::plus<>(),
+                                             [](int a, int b) { return static_cast<long long>(a) * b; }));
+        });
+
+        runner.run("chain", "stream", size, [&] {
+            doNotOptimize(streams::from(data).chain(streams::from(other)).fold(0, std::plus<>()));
+        });
+        runner.run("chain", "loop", size, [&] {
+            int sum = 0;
+            for (int e : data) {
+                sum += e;
+            }
+            for (int e : other) {
+                sum += e;
+            }
+            doNotOptimize(sum);
+        });
+        runner.run("chain", "algorithm", size, [&] {
+            doNotOptimize(std::accumulate(other.begin(), other.end(), std::accumulate(data.begin(), data.end(), 0)));
+        });
+
+        runner.run("enumerate", "stream", size, [&] {
+            doNotOptimize(streams::from(data).enumerate()
+                .fold(size_t{0}, [](size_t a, auto& e) { return a + e.i * static_cast<size_t>(e.v); }));
+        });
+        runner.run("enumerate", "loop", size, [&] {
+            size_t sum = 0;
+            for (size_t i = 0; i < size; ++i) {
+                sum += i * static_cast<size_t>(data[i]);
+            }
+            doNotOptimize(sum);
+        });
+        runner.run("enumerate", "algorithm", size, [&] {
+            size_t i = 0;
+            doNotOptimize(std::accumulate(data.begin(), data.end(), size_t{0}, [&i](size_t a, int e) {
+                return a + i++ * static_cast<size_t>(e);
+            }));
+        });
+
+        runner.run("skipTake", "stream", size, [&] {
+            doNotOptimize(streams::from(data).skip(size / 4).take(size / 2).fold(0, std::plus<>()));
+        });
+        runner.run("skipTake", "loop", size, [&] {
+            int sum = 0;
+            for (size_t i = size / 4; i < size / 4 + size / 2; ++i) {
+                sum += data[i];
+            }
+            doNotOptimize(sum);
+        });
+        runner.run("skipTake", "algorithm", size, [&] {
+            auto begin = data.begin() + static_cast<std::ptrdiff_t>(size / 4);
+            doNotOptimize(std::accumulate(begin, begin + static_cast<std::ptrdiff_t>(size / 2), 0));
+        });
+
+        std::vector<streams::Optional<int>> optionals;
+        for (int e : data) {
+            optionals.push_back(e % 2 == 0 ? streams::Optional<int>(e) : streams::nullopt);
+        }
+        runner.run("purify", "stream", size, [&] {
+            doNotOptimize(streams::from(optionals).purify().fold(0, std::plus<>()));
+        });
+        runner.run("purify", "loop", size, [&] {
+            int sum = 0;
+            for (auto& e : optionals) {
+                if (e) {
+                    sum += *e;
+                }
+            }
+            doNotOptimize(sum);
+        });
+        runner.run("purify", "algorithm", size, [&] {
+            doNotOptimize(std::accumulate(optionals.begin(), optionals.end(), 0, [](int a, const streams::Optional<int>& e) {
+                return e ? a + *e : a;
+            }));
+        });
+    }
+
+    void benchmarkTerminals(Runner& runner, size_t size) {
+        const std::vector<int> data = makeData(size);
+        auto even = [](auto& e) { return e % 2 == 0; };
+
+        runner.run("fold", "stream", size, [&] {
+            doNotOptimize(streams::from(data).fold(0, std::plus<>()));
+        });
+        runner.run("fold", "loop", size, [&] {
+            int sum = 0;
+            for (int e : data) {
+                sum += e;
+            }
+            doNotOptimize(sum);
+        });
+        runner.run("fold", "algorithm", size, [&] {
+            doNotOptimize(std::accumulate(data.begin(), data.end(), 0));
+        });
+
+        runner.run("collect", "stream", size, [&] {
+            doNotOptimize(streams::from(data).map([](auto& e) { return e * 2; }).collect());
+        });
+        runner.run("collect", "loop", size, [&] {
+            std::vector<int> result;
+            result.reserve(data.size());
+            for (int e : data) {
+                result.push_back(e * 2);
+            }
+            doNotOptimize(result);
+        });
+        runner.run("collect", "algorithm", size, [&] {
+            std::vector<int> result;
+            result.reserve(data.size());
+            std::transform(data.begin(), data.end(), std::back_inserter(result), [](int e) { return e * 2; });
+            doNotOptimize(result);
+        });
+
+        runner.run("min", "stream", size, [&] {
+            doNotOptimize(streams::from(data).min());
+        });
+        runner.run("min", "loop", size, [&] {
+            int min = data.empty() ? 0 : data[0];
+            for (int e : data) {
+                min = e < min ? e : min;
+            }
+            doNotOptimize(min);
+        });
+        runner.run("min", "algorithm", size, [&] {
+            doNotOptimize(std::min_element(data.begin(), data.end()));
+        });
+
+        runner.run("partition", "stream", size, [&] {
+            doNotOptimize(streams::from(data).partition(even));
+        });
+        runner.run("partition", "loop", size, [&] {
+            std::pair<std::vector<int>, std::vector<int>> result;
+            result.first.reserve(data.size() - data.size() / 2); // as partition() splits its reservation
+            result.second.reserve(data.size() / 2);
+            for (int e : data) {
+                (e % 2 == 0 ? result.first : result.second).push_back(e);
+            }
+            doNotOptimize(result);
+        });
+        runner.run("partition", "algorithm", size, [&] {
+            std::pair<std::vector<int>, std::vector<int>> result;
+            result.first.reserve(data.size() - data.size() / 2);
+            result.second.reserve(data.size() / 2);
+            std::partition_copy(data.begin(), data.end(), std::back_inserter(result.first), std::back_inserter(result.second), even);
+            doNotOptimize(result);
+        });
+
+        auto key = [](int e) { return e % 100; };
+        runner.run("countBy", "stream", size, [&] {
+            doNotOptimize(streams::from(data).countBy(key).size());
+        });
+        runner.run("countBy", "loop", size, [&] {
+            std::unordered_map<int, size_t> counts;
+            for (int e : data) {
+                ++counts[key(e)];
+            }
+            doNotOptimize(counts.size());
+        });
+        runner.run("countBy", "algorithm", size, [&] {
+            std::vector<int> keys(data.size());
+            std::transform(data.begin(), data.end(), keys.begin(), key);
+            std::sort(keys.begin(), keys.end());
+            doNotOptimize(std::unique(keys.begin(), keys.end()) - keys.begin());
+        });
+    }
+
+    Options parseOptions(int argc, char** argv) {
+        Options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg.compare(0, 9, "--filter=") == 0) {
+                options.filter = arg.substr(9);
+            } else if (arg.compare(0, 11, "--min-time=") == 0) {
+                options.minTime = std::atof(arg.c_str() + 11);
+            } else if (arg.compare(0, 6, "--out=") == 0) {
+                options.out = arg.substr(6);
+            } else {
+                std::cerr << "usage: " << argv[0] << " [--filter=<substring>] [--min-time=<seconds>] [--out=<file.json>]\n";
+                std::exit(1);
+            }
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv) {
+    Runner runner(parseOptions(argc, argv));
+    for (size_t size : { 16u, 1024u, 65536u, 1048576u }) {
+        benchmarkAdaptors(runner, size);
+        benchmarkTerminals(runner, size);
+    }
+    runner.report();
+}
@@ -5,6 +5,10 @@
 #include <utility>
 #include <list>
 #include <iostream>
+#include <atomic>
+#include <memory>
+#include <fstream>
+#include <iterator>
 #include "../Streams.h"
 #include "gtest/gtest.h"
 
@@ -25,6 +29,27 @@ protected:
     }
 };
 
+namespace {
+    struct CopyCounter {
+        static size_t copies;
+
+        int value;
+        CopyCounter(int v) : value(v) {}
+        CopyCounter(const CopyCounter& other) : value(other.value) { ++copies; }
+        CopyCounter(CopyCounter&&) = default;
+        CopyCounter& operator = (const CopyCounter&) = default;
+    };
+    size_t CopyCounter::copies = 0;
+
+    std::vector<CopyCounter> makeCounters(int size) {
+        std::vector<CopyCounter> result;
+        for (int i = 0; i < size; ++i) {
+            result.emplace_back(i);
+        }
+        return result;
+    }
+}
+
 
 TEST_F(GeneralTests, ForEach) {
     std::vector<int> vec;
@@ -73,6 +98,29 @@ TEST_F(GeneralTests, CollectAsOther) {
     ASSERT_EQ(lst, vec);
 }
 
+TEST_F(GeneralTests, FromTemporary) {
+    CopyCounter::copies = 0;
+    auto sum = streams::from(makeCounters(10))
+        .map([](auto& c) { return c.value; })
+        .fold(0, std::plus<int>{});
+
+    ASSERT_EQ(45, sum);
+    ASSERT_EQ(0u, CopyCounter::copies);
+}
+
+TEST_F(GeneralTests, FromTemporaryCopies) {
+    auto make = []() {
+        auto s = streams::from(std::string("short"));
+        s.next();
+        return s;
+    };
+    auto moved = make();
+    auto copy = moved;
+
+    ASSERT_EQ((std::vector<char>{ 'h', 'o', 'r', 't' }), moved.collect());
+    ASSERT_EQ((std::vector<char>{ 'h', 'o', 'r', 't' }), copy.collect());
+}
+
 
 TEST_F(GeneralTests, MapSameType) {
     auto vec = getStream()
@@ -95,6 +143,43 @@ TEST_F(GeneralTests, MapChangeType) {
     ASSERT_EQ(check, vec);
 }
 
+TEST_F(GeneralTests, MapEvaluatesOnce) {
+    size_t calls = 0;
+    auto s = getStream()
+        .map([&calls](auto& v) { ++calls; return v; })
+        .filter([](auto& v) { return v % 2 == 0; })
+        .spy([](auto&) {});
+
+    ASSERT_EQ(0, *s.next());
+    ASSERT_EQ(2, *s.next());
+    ASSERT_EQ(3u, calls);
+
+    ASSERT_EQ(98, *s.last());
+    ASSERT_EQ(100u, calls);
+}
+
+TEST_F(GeneralTests, MapMoveOnly) {
+    auto vec = getStream()
+        .map([](auto& v) { return std::make_unique<int>(v); })
+        .filter([](auto& p) { return *p < 10; })
+        .collect();
+
+    ASSERT_EQ(10u, vec.size());
+    ASSERT_EQ(9, *vec.back());
+}
+
+TEST_F(GeneralTests, MapNotDefaultConstructible) {
+    struct Wrapper {
+        explicit Wrapper(int v) : value(v) {}
+        int value;
+    };
+    auto m = getStream()
+        .map([](auto& v) { return Wrapper(v); })
+        .max([](auto& lhs, auto& rhs) { return lhs.value > rhs.value; });
+
+    ASSERT_EQ(99, m->value);
+}
+
 
 TEST_F(GeneralTests, FilterSome) {
     auto vec = getStream()
@@ -322,6 +407,17 @@ TEST_F(GeneralTests, Count) {
 
     std::vector<int> v;
     ASSERT_EQ(0, streams::from(v).count());
+
+    // elements are only advanced over, transforms run only when a filter needs their results
+    size_t calls = 0;
+    auto counted = [&calls](int e) { ++calls; return e; };
+    auto even = [](int e) { return e % 2 == 0; };
+    ASSERT_EQ(100u, getStream().map(counted).count());
+    ASSERT_EQ(50u, getStream().filter(even).map(counted).count());
+    ASSERT_EQ(4u, getStream().map(counted).take(5).skip(1).count());
+    ASSERT_EQ(0u, calls);
+    ASSERT_EQ(50u, getStream().map(counted).filter(even).count());
+    ASSERT_EQ(100u, calls);
 }
 
 
@@ -413,6 +509,33 @@ TEST_F(GeneralTests, LastSome) {
     ASSERT_EQ(*(vector.end()-1), *last);
 }
 
+namespace {
+    struct CountedCopies {
+        int value;
+        size_t* copies;
+
+        CountedCopies(int value, size_t* copies) : value(value), copies(copies) {}
+        CountedCopies(const CountedCopies& other) : value(other.value), copies(other.copies) { ++*copies; }
+        CountedCopies& operator = (const CountedCopies& other) {
+            value = other.value;
+            copies = other.copies;
+            ++*copies;
+            return *this;
+        }
+    };
+}
+
+TEST_F(GeneralTests, LastCopiesOnce) {
+    size_t copies = 0;
+    std::vector<CountedCopies> items;
+    items.reserve(10);
+    for (int i = 0; i < 10; ++i) {
+        items.emplace_back(i, &copies);
+    }
+    ASSERT_EQ(9, streams::from(items).last()->value);
+    ASSERT_EQ(1u, copies);
+}
+
 TEST_F(GeneralTests, LastNone) {
     std::vector<int> v{};
     auto last = streams::from(v).last();
@@ -447,6 +570,45 @@ TEST_F(GeneralTests, EnumerateTup) {
     ASSERT_EQ(check, s);
 }
 
+TEST_F(GeneralTests, EnumerateRef) {
+    std::vector<std::string> words{ "zero", "one", "two" };
+    size_t visited = 0;
+    streams::from(words)
+        .enumerateRef()
+        .forEach([&words, &visited](auto& e) {
+            ASSERT_EQ(&words[e.i], &e.v);
+            ++visited;
+        });
+    ASSERT_EQ(words.size(), visited);
+
+    auto s = streams::from(words).enumerateRef(1);
+    s.next();
+    auto second = s.next();
+    ASSERT_EQ(2u, second->i);
+    ASSERT_EQ(&words[1], &second->v);
+}
+
+TEST_F(GeneralTests, ZipRef) {
+    std::vector<std::string> names{ "a", "b", "c", "d" };
+    size_t visited = 0;
+    getStream()
+        .zipRef(streams::from(names))
+        .forEach([this, &names, &visited](auto& t) {
+            ASSERT_EQ(&vector[visited], &std::get<0>(t));
+            ASSERT_EQ(&names[visited], &std::get<1>(t));
+            ++visited;
+        });
+    ASSERT_EQ(names.size(), visited);
+
+    auto mapped = getStream()
+        .map([](auto& v) { return v * 2; })
+        .zipRef(getStream().skip(1))
+        .filter([](auto& t) { return std::get<0>(t) > 10; });
+    auto first = mapped.next(); // refers to the stream's current element
+    ASSERT_EQ(12, std::get<0>(*first));
+    ASSERT_EQ(7, std::get<1>(*first));
+}
+
 
 TEST_F(GeneralTests, ChainAll) {
     auto s1 = getStream();
@@ -562,6 +724,70 @@ TEST_F(GeneralTests, Flatten) {
     ASSERT_EQ(check, res);
 }
 
+TEST_F(GeneralTests, FlattenInPlace) {
+    std::vector<std::vector<int>> nested{ {1, 2}, {}, {3} };
+    std::vector<const int*> addresses;
+    streams::from(nested).flatten().forEach([&addresses](auto& e) { addresses.push_back(&e); });
+
+    std::vector<const int*> check{ &nested[0][0], &nested[0][1], &nested[2][0] };
+    ASSERT_EQ(check, addresses);
+}
+
+TEST_F(GeneralTests, FlattenCopyOutlivesOriginal) {
+    std::vector<std::vector<int>> nested{ {1, 2, 3}, {4}, {5, 6} };
+    auto make = [&nested] {
+        auto s = streams::from(nested).map([](auto& v) { return v; }).flatten();
+        s.next();
+        return s;
+    };
+
+    // the inner collection referenced the value cached by map(), which the copy doesn't share
+    auto copy = make().take(100);
+    ASSERT_EQ((std::vector<int>{ 2, 3, 4, 5, 6 }), copy.collect());
+}
+
+TEST_F(GeneralTests, FlatMapManyEmpty) {
+    std::vector<std::vector<int>> nested(100000);
+    nested.back().push_back(42);
+
+    ASSERT_EQ(42, *streams::from(nested).flatten().next());
+    ASSERT_EQ(0u, streams::generate::counter()
+        .take(100000)
+        .flatMap([](auto&) { return std::vector<int>{}; })
+        .count());
+}
+
+TEST_F(GeneralTests, FlatMapStream) {
+    auto res = streams::generate::counter(1)
+        .flatMap([](auto& n) { return streams::generate::counter(n * 10).take(n); })
+        .take(6)
+        .collect();
+
+    std::vector<size_t> check{ 10, 20, 21, 30, 31, 32 };
+    ASSERT_EQ(check, res);
+
+    auto words = std::vector<std::string>{ "ab", "c" };
+    auto chars = streams::from(words)
+        .flatMap([](auto& w) { return streams::from(w).map([](auto& c) { return static_cast<char>(c - 32); }); })
+        .collect();
+    ASSERT_EQ((std::vector<char>{ 'A', 'B', 'C' }), chars);
+}
+
+TEST_F(GeneralTests, FlatMapCopyKeepsPosition) {
+    auto s = getStream().take(2).flatMap([](auto& e) { return std::vector<int>{ e, e, e }; });
+    s.next();
+    auto copy = s;
+    s.next();
+    ASSERT_EQ((std::vector<int>{ 0, 1, 1, 1 }), s.collect());
+    ASSERT_EQ((std::vector<int>{ 0, 0, 1, 1, 1 }), copy.collect());
+
+    // parallel parts of a started stream keep the rest of the current inner stream
+    auto started = getStream().flatMap([](auto& e) { return std::vector<int>{ e, e, e }; });
+    started.next();
+    ASSERT_EQ(299u, started.parallel(4).count());
+    ASSERT_EQ(14850, started.parallel(4).fold(0, std::plus<>{}, std::plus<>{}));
+}
+
 
 TEST_F(GeneralTests, Min) {
     auto m = getStream().min();
@@ -666,6 +892,1073 @@ TEST_F(GeneralTests, GeneratorCounter) {
 }
 
 
+TEST_F(GeneralTests, ParallelFold) {
+    auto sum = getStream()
+        .filter([](auto& e) { return e % 3 == 0; })
+        .map([](auto& e) { return e * 2; })
+        .parallel(4)
+        .fold(0, std::plus<int>{}, std::plus<int>{});
+
+    int check = 0;
+    for (int i : vector) {
+        if (i % 3 == 0) {
+            check += i * 2;
+        }
+    }
+    ASSERT_EQ(check, sum);
+}
+
+TEST_F(GeneralTests, ParallelFoldKeepsOrder) {
+    auto joined = getStream()
+        .map([](auto& e) { return std::to_string(e); })
+        .parallel(3)
+        .fold(std::string{}, std::plus<std::string>{}, std::plus<std::string>{});
+
+    std::string check;
+    for (int i : vector) {
+        check += std::to_string(i);
+    }
+    ASSERT_EQ(check, joined);
+}
+
+TEST_F(GeneralTests, ParallelEnumerate) {
+    auto sum = getStream()
+        .enumerate()
+        .parallel(4)
+        .fold(size_t{0}, [](size_t a, auto& e) { return a + e.i * static_cast<size_t>(e.v); }, std::plus<size_t>{});
+
+    size_t check = 0;
+    for (size_t i = 0; i < vector.size(); ++i) {
+        check += i * static_cast<size_t>(vector[i]);
+    }
+    ASSERT_EQ(check, sum);
+}
+
+TEST_F(GeneralTests, ParallelForEachAndCount) {
+    std::atomic<int> sum {0};
+    getStream().parallel(4).forEach([&sum](auto& e) { sum += e; });
+
+    ASSERT_EQ(std::accumulate(vector.begin(), vector.end(), 0), sum.load());
+    ASSERT_EQ(vector.size(), getStream().parallel(8).count());
+    ASSERT_EQ(50u, getStream().filter([](auto& e) { return e % 2; }).parallel(3).count());
+}
+
+TEST_F(GeneralTests, ParallelMinMax) {
+    ASSERT_EQ(0, *getStream().parallel(4).min());
+    ASSERT_EQ(99, *getStream().parallel(4).max());
+
+    std::vector<int> v{};
+    ASSERT_EQ(false, static_cast<bool>(streams::from(v).parallel(4).min()));
+}
+
+TEST_F(GeneralTests, SizeHintExact) {
+    auto hint = getStream()
+        .map([](auto& e) { return e * 2; })
+        .enumerate()
+        .skip(10)
+        .take(50)
+        .sizeHint();
+
+    ASSERT_TRUE(hint.exact());
+    ASSERT_EQ(50u, hint.lower);
+
+    auto chained = getStream().chain(getStream()).zip(getStream().skip(20)).sizeHint();
+    ASSERT_TRUE(chained.exact());
+    ASSERT_EQ(80u, chained.lower);
+
+    ASSERT_EQ(7u, *streams::generate::counter().take(7).sizeHint().upper);
+}
+
+TEST_F(GeneralTests, SizeHintBounds) {
+    auto filtered = getStream().filter([](auto& e) { return e % 2; }).sizeHint();
+    ASSERT_FALSE(filtered.exact());
+    ASSERT_EQ(0u, filtered.lower);
+    ASSERT_EQ(vector.size(), *filtered.upper);
+
+    std::list<int> lst(vector.begin(), vector.end());
+    ASSERT_FALSE(static_cast<bool>(streams::from(lst).sizeHint().upper));
+    ASSERT_FALSE(static_cast<bool>(streams::generate::counter().sizeHint().upper));
+
+    // the lower bound of an infinite stream saturates instead of wrapping around
+    const size_t infinite = std::numeric_limits<size_t>::max();
+    ASSERT_EQ(infinite, streams::generate::counter().sizeHint().lower);
+    ASSERT_EQ(infinite, streams::generate::counter().chain(streams::generate::counter()).sizeHint().lower);
+    ASSERT_EQ(infinite - 2, streams::generate::counter().windows(3).sizeHint().lower);
+    auto windows = streams::generate::counter().windows(3);
+    windows.next();
+    ASSERT_EQ(infinite, windows.sizeHint().lower);
+}
+
+TEST_F(GeneralTests, CollectReserves) {
+    auto vec = getStream()
+        .map([](auto& e) { return e + 1; })
+        .skip(30)
+        .collect();
+
+    ASSERT_EQ(70u, vec.size());
+    ASSERT_EQ(70u, vec.capacity());
+
+    // the size hint is split between the sides of a partition rather than reserved for both
+    auto parts = getStream().partition([](auto& e) { return e < 90; });
+    ASSERT_EQ(90u, parts.first.size());
+    ASSERT_EQ(10u, parts.second.size());
+    ASSERT_EQ(50u, parts.second.capacity());
+}
+
+TEST_F(GeneralTests, EarlyStopKeepsState) {
+    std::vector<std::string> words{ "ab", "", "cd", "e" };
+    auto flat = streams::from(words).flatten();
+    ASSERT_TRUE(flat.any([](auto& c) { return c == 'b'; }));
+    ASSERT_EQ('c', *flat.next());
+    ASSERT_EQ('e', *flat.find([](auto& c) { return c == 'e'; }));
+    ASSERT_FALSE(static_cast<bool>(flat.next()));
+
+    auto chained = getStream().take(3).chain(getStream().skip(97));
+    ASSERT_FALSE(chained.all([](auto& e) { return e < 2; }));
+    ASSERT_EQ((std::vector<int>{ 97, 98, 99 }), chained.collect());
+
+    auto taken = getStream().skipWhile([](auto& e) { return e < 10; }).takeWhile([](auto& e) { return e < 20; });
+    ASSERT_EQ(12, *taken.find([](auto& e) { return e > 11; }));
+    ASSERT_EQ(7u, taken.count());
+}
+
+namespace {
+    template<typename T>
+    void checkBlockwise() {
+        static_assert(streams::SequenceStreamExtractor<typename std::vector<T>::const_iterator>::blockwise, "");
+        for (size_t size : { 0u, 1u, 7u, 31u, 32u, 33u, 255u, 256u, 257u, 1000u }) {
+            std::vector<T> data;
+            for (size_t i = 0; i < size; ++i) {
+                data.push_back(static_cast<T>((i * 37) % 101) - 50);
+            }
+            ASSERT_EQ(std::accumulate(data.begin(), data.end(), T{}), streams::from(data).fold(T{}, std::plus<T>()));
+            ASSERT_EQ(size, streams::from(data).count());
+            if (size == 0) {
+                ASSERT_FALSE(static_cast<bool>(streams::from(data).min()));
+                continue;
+            }
+            ASSERT_EQ(*std::min_element(data.begin(), data.end()), *streams::from(data).min());
+            ASSERT_EQ(*std::max_element(data.begin(), data.end()), *streams::from(data).max());
+
+            auto positive = [](auto& e) { return e > 0; };
+            auto twice = [](auto& e) { return e * 2; };
+            T expected {};
+            size_t kept = 0;
+            for (T e : data) {
+                if (e > 0) {
+                    expected += e * 2;
+                    ++kept;
+                }
+            }
+            ASSERT_EQ(expected, streams::from(data).filter(positive).map(twice).fold(T{}, std::plus<>()));
+            ASSERT_EQ(kept, streams::from(data).filter(positive).count());
+            ASSERT_EQ(*std::min_element(data.begin(), data.end()) * 2, *streams::from(data).map(twice).min());
+        }
+    }
+}
+
+TEST_F(GeneralTests, Blockwise) {
+    checkBlockwise<int>();
+    checkBlockwise<float>();
+    checkBlockwise<double>();
+    checkBlockwise<long>();
+
+    // other folds and comparators go element by element, sums into another type use a plain loop
+    ASSERT_EQ(4950 * 3, getStream().fold(0, [](int a, int e) { return a + 3 * e; }));
+    ASSERT_EQ(99, *getStream().min([](int a, int b) { return a > b; }));
+    ASSERT_EQ(4950.0, getStream().fold(0.0, std::plus<>()));
+}
+
+TEST_F(GeneralTests, BlockwiseEvaluationOrder) {
+    std::string calls;
+    auto p = [&calls](auto& e) { calls += 'p'; return e % 2 == 0; };
+    auto q = [&calls](auto& e) { calls += 'q'; return e % 3 == 0; };
+    auto f = [&calls](auto& e) { calls += 'f'; return e + 1; };
+
+    // a user fold sees the filters interleaved, as pulling does
+    std::vector<int> small{ 0, 1, 2, 3 };
+    ASSERT_EQ(3, streams::from(small).filter(p).filter(q).fold(0, [](int a, int e) { return a + e + 3; }));
+    ASSERT_EQ("pqppqp", calls);
+
+    // count() runs each stage over a block before the next one
+    calls.clear();
+    ASSERT_EQ(2u, streams::from(small).map(f).filter(p).count());
+    ASSERT_EQ("ffffpppp", calls);
+}
+
+
+TEST_F(GeneralTests, CompactExtractors) {
+    auto stream = getStream();
+    auto filtered = stream.filter([](auto& e) { return e % 2 == 0; });
+    auto slice = stream.skip(1).take(2);
+    ASSERT_EQ(sizeof(stream), sizeof(filtered));
+    ASSERT_EQ(sizeof(stream) + 2 * sizeof(size_t), sizeof(slice));
+
+    auto mapped = stream.map([](auto& e) { return e * 2; });
+    auto mappedTwice = mapped.map([](auto& e) { return e + 1; });
+    auto filteredMapped = filtered.map([](auto& e) { return e * 2; });
+    ASSERT_EQ(sizeof(mapped), sizeof(mappedTwice));
+    ASSERT_EQ(sizeof(mapped), sizeof(filteredMapped));
+}
+
+TEST_F(GeneralTests, FusedAdaptors) {
+    auto twice = [](auto& e) { return e * 2; };
+    auto even = [](auto& e) { return e % 4 == 0; };
+    auto toString = [](auto& e) { return std::to_string(e); };
+
+    ASSERT_EQ((std::vector<std::string>{ "1", "3", "5" }), getStream().map(twice).map([](auto& e) { return e + 1; }).map(toString).take(3).collect());
+    ASSERT_EQ((std::vector<int>{ 0, 8, 16 }), getStream().filter(even).map(twice).take(3).collect());
+    ASSERT_EQ((std::vector<std::string>{ "0", "8" }), getStream().filter(even).map(twice).map(toString).take(2).collect());
+    ASSERT_EQ(25u, getStream().filter(even).map(twice).count());
+    ASSERT_EQ(2400, getStream().filter(even).map(twice).fold(0, std::plus<>()));
+    ASSERT_EQ(2400, getStream().filter(even).map(twice).parallel(3).fold(0, std::plus<>(), std::plus<>()));
+
+    auto slice = getStream().skip(10).take(5).take(3);
+    ASSERT_EQ(3u, slice.sizeHint().lower);
+    ASSERT_EQ(10, *slice.next());
+    ASSERT_EQ((std::vector<int>{ 11, 12 }), slice.collect());
+    ASSERT_EQ(0u, getStream().skip(200).take(3).count());
+
+    // a partially consumed stream keeps its position when fused
+    auto mapped = getStream().map(twice);
+    mapped.next();
+    ASSERT_EQ(3, *mapped.map([](auto& e) { return e + 1; }).next());
+}
+
+TEST_F(GeneralTests, RandomAccessSkip) {
+    auto twice = [](auto& e) { return e * 2; };
+    auto page = getStream().map(twice).enumerate().skip(50).take(3);
+    static_assert(decltype(page.extractor)::randomAccess, "");
+    ASSERT_EQ(3u, page.sizeHint().lower);
+    ASSERT_EQ((std::vector<streams::Enumerated<int>>{ { 50, 100 }, { 51, 102 }, { 52, 104 } }), page.collect());
+
+    // generators jump as well, one step at a time this would never finish
+    const size_t far = size_t{ 1 } << 50;
+    ASSERT_EQ(far, *streams::generate::counter().skip(far).next());
+    ASSERT_EQ(far + 7, *streams::generate::counter().map([](auto& e) { return e + 7; }).nth(far));
+
+    auto chained = getStream().take(10).chain(getStream().skip(90));
+    ASSERT_EQ(92, *chained.nth(12));
+    ASSERT_EQ(93, *chained.next());
+    ASSERT_FALSE(static_cast<bool>(chained.nth(10)));
+
+    auto zipped = getStream().zip(getStream().skip(5));
+    ASSERT_EQ(std::make_tuple(90, 95), *zipped.nth(90));
+    ASSERT_EQ(4u, zipped.count());
+
+    // a skip over a stream that has to be walked still works
+    ASSERT_EQ(60, *getStream().filter([](auto& e) { return e % 3 == 0; }).skip(20).next());
+    ASSERT_FALSE(static_cast<bool>(getStream().skip(100).next()));
+}
+
+TEST_F(GeneralTests, StepBy) {
+    ASSERT_EQ((std::vector<int>{ 0, 30, 60, 90 }), getStream().stepBy(30).collect());
+    ASSERT_EQ((std::vector<int>{ 30, 60, 90 }), getStream().stepBy(30).skip(1).collect());
+    ASSERT_EQ(100u, getStream().stepBy(0).count());
+
+    auto stepped = getStream().stepBy(7);
+    ASSERT_TRUE(stepped.sizeHint().exact());
+    ASSERT_EQ(15u, stepped.sizeHint().lower);
+    ASSERT_EQ(0, *stepped.next());
+    ASSERT_EQ(14u, stepped.sizeHint().lower);
+    ASSERT_EQ(21, *stepped.nth(2));
+    ASSERT_EQ(28, *stepped.next());
+    ASSERT_EQ(10u, stepped.count());
+
+    // strided sampling of a walked stream
+    ASSERT_EQ((std::vector<int>{ 1, 7, 13 }), getStream().filter([](auto& e) { return e % 2 == 1; }).stepBy(3).take(3).collect());
+    ASSERT_EQ(3 * (size_t{ 1 } << 40), *streams::generate::counter().stepBy(3).nth(size_t{ 1 } << 40));
+
+    // a partial skip after the first element counts only the elements actually passed
+    std::vector<int> head{ 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+    std::vector<int> tail{ 100, 101, 102, 103 };
+    auto partial = streams::from(head).stepBy(3);
+    ASSERT_EQ(0, *partial.next());
+    ASSERT_EQ(2u, partial.extractor.advanceBy(5));
+
+    auto chained = streams::from(head).stepBy(3).chain(streams::from(tail));
+    ASSERT_EQ(0, *chained.next());
+    ASSERT_EQ(101, *chained.nth(3));
+
+    auto skipped = streams::from(head).stepBy(3).chain(streams::from(tail));
+    ASSERT_EQ(0, *skipped.next());
+    ASSERT_EQ((std::vector<int>{ 101, 102, 103 }), skipped.skip(3).collect());
+}
+
+namespace {
+    template<typename T>
+    std::vector<std::vector<T>> toVectors(std::vector<streams::Span<T>> spans) {
+        std::vector<std::vector<T>> result;
+        for (auto& span : spans) {
+            result.emplace_back(span.begin(), span.end());
+        }
+        return result;
+    }
+}
+
+TEST_F(GeneralTests, Chunks) {
+    auto chunks = getStream().chunks(30);
+    ASSERT_EQ(4u, chunks.sizeHint().lower);
+    auto first = *chunks.next();
+    ASSERT_EQ(vector.data(), first.data());
+    ASSERT_EQ(30u, first.size());
+    auto last = *chunks.nth(2);
+    ASSERT_EQ(vector.data() + 90, last.data());
+    ASSERT_EQ(10u, last.size());
+    ASSERT_FALSE(static_cast<bool>(chunks.next()));
+
+    auto mapped = getStream().skip(90).map([](auto& e) { return e - 90; }).chunks(4);
+    ASSERT_EQ(3u, mapped.sizeHint().lower);
+    std::vector<std::vector<int>> copies;
+    mapped.forEach([&copies](auto& span) { copies.emplace_back(span.begin(), span.end()); });
+    ASSERT_EQ((std::vector<std::vector<int>>{ { 0, 1, 2, 3 }, { 4, 5, 6, 7 }, { 8, 9 } }), copies);
+
+    // spans into the collection stay valid
+    ASSERT_EQ((std::vector<std::vector<int>>{ { 0, 1, 2 }, { 3, 4, 5 } }), toVectors(getStream().chunks(3).take(2).collect()));
+
+    std::vector<int> sums;
+    getStream().filter([](auto& e) { return e < 7; }).chunks(3).forEach([&sums](auto& span) {
+        sums.push_back(std::accumulate(span.begin(), span.end(), 0));
+    });
+    ASSERT_EQ((std::vector<int>{ 3, 12, 6 }), sums);
+    ASSERT_EQ(100u, getStream().chunks(0).count());
+}
+
+TEST_F(GeneralTests, Windows) {
+    auto windows = getStream().windows(10);
+    ASSERT_EQ(91u, windows.sizeHint().lower);
+    ASSERT_EQ(vector.data() + 5, windows.nth(5)->data());
+    ASSERT_EQ(85u, windows.count());
+    ASSERT_EQ(0u, getStream().take(3).windows(4).count());
+
+    // moving average over a stream without contiguous storage
+    auto averages = getStream().map([](auto& e) { return static_cast<double>(e); }).windows(4).map([](auto& window) {
+        return std::accumulate(window.begin(), window.end(), 0.0) / static_cast<double>(window.size());
+    });
+    ASSERT_EQ(97u, averages.sizeHint().lower);
+    ASSERT_EQ(1.5, *averages.next());
+    ASSERT_EQ(2.5, *averages.next());
+    ASSERT_EQ(95.5, *averages.nth(92));
+    ASSERT_EQ(2u, averages.count());
+
+    std::vector<std::vector<int>> expected{ { 1, 3, 5 }, { 3, 5, 7 }, { 5, 7, 9 } };
+    std::vector<std::vector<int>> actual;
+    getStream().filter([](auto& e) { return e % 2 == 1; }).take(5).windows(3).forEach([&actual](auto& window) {
+        actual.emplace_back(window.begin(), window.end());
+    });
+    ASSERT_EQ(expected, actual);
+
+    auto owned = streams::from(std::vector<int>{ 1, 2, 3 }).windows(2);
+    ASSERT_EQ(2u, owned.sizeHint().lower);
+    ASSERT_EQ(3, owned.nth(1)->back());
+}
+
+TEST_F(GeneralTests, TopK) {
+    std::vector<int> shuffled;
+    for (int i = 0; i < 100; ++i) {
+        shuffled.push_back((i * 37) % 100);
+    }
+    std::vector<int> expected = shuffled;
+    std::partial_sort(expected.begin(), expected.begin() + 10, expected.end());
+    expected.resize(10);
+    ASSERT_EQ(expected, streams::from(shuffled).topK(10));
+
+    ASSERT_EQ((std::vector<int>{ 99, 98, 97 }), streams::from(shuffled).topK(3, std::greater<>{}));
+    ASSERT_EQ((std::vector<int>{ 1, 3, 5, 7 }), getStream().filter([](auto& e) { return e % 2 == 1; }).take(4).topK(10));
+    ASSERT_TRUE(getStream().topK(0).empty());
+}
+
+TEST_F(GeneralTests, Sorted) {
+    std::vector<int> shuffled;
+    for (int i = 0; i < 100; ++i) {
+        shuffled.push_back((i * 37) % 100);
+    }
+    auto sorted = streams::from(shuffled).sorted();
+    ASSERT_EQ(100u, sorted.sizeHint().lower);
+    ASSERT_EQ(0, *sorted.next());
+    ASSERT_EQ(99u, sorted.sizeHint().lower);
+    ASSERT_EQ(99u, *sorted.sizeHint().upper);
+    ASSERT_EQ(vector, streams::from(shuffled).sorted().collect());
+    ASSERT_EQ(vector, streams::from(shuffled).sorted(std::less<>{}, 7).collect());
+
+    // merged runs of a non-trivially copyable type stay in memory
+    auto strings = streams::from(shuffled).map([](auto& e) { return std::to_string(e); }).sorted(std::less<>{}, 16).collect();
+    ASSERT_TRUE(std::is_sorted(strings.begin(), strings.end()));
+    ASSERT_EQ(100u, strings.size());
+
+    // equal elements keep their order
+    auto byTens = [](auto& l, auto& r) { return l / 10 < r / 10; };
+    std::vector<int> expected = shuffled;
+    std::stable_sort(expected.begin(), expected.end(), byTens);
+    ASSERT_EQ(expected, streams::from(shuffled).sorted(byTens, 9).collect());
+
+    auto descending = streams::from(shuffled).sorted(std::greater<>{}, 30).skip(95);
+    ASSERT_EQ((std::vector<int>{ 4, 3, 2, 1, 0 }), descending.collect());
+    ASSERT_FALSE(getStream().take(0).sorted().next());
+
+#ifdef STREAMS_HAS_MMAP
+    // a spilled run that can't be read back is an error, not the end of the run
+    std::vector<int> large;
+    for (int i = 0; i < 20000; ++i) {
+        large.push_back((i * 7919) % 20000);
+    }
+    auto merged = streams::from(large).sorted(std::less<>{}, 8000).collect();
+    ASSERT_EQ(20000u, merged.size());
+    ASSERT_TRUE(std::is_sorted(merged.begin(), merged.end()));
+
+    auto spilled = streams::from(large).sorted(std::less<>{}, 8000);
+    ASSERT_EQ(0, *spilled.next());
+    size_t truncated = 0;
+    for (auto& run : spilled.extractor.runs) {
+        if (run.file) {
+            ASSERT_EQ(0, ftruncate(fileno(run.file.get()), 0));
+            ++truncated;
+        }
+    }
+    ASSERT_NE(0u, truncated);
+    ASSERT_THROW(spilled.collect(), std::system_error);
+#endif
+}
+
+TEST_F(GeneralTests, GroupBy) {
+    auto sums = getStream().groupBy([](auto& e) { return e % 3; }, 0, std::plus<>{});
+    ASSERT_EQ(3u, sums.size());
+    ASSERT_EQ(1683, *sums.find(0));
+    ASSERT_EQ(1617, *sums.find(1));
+    ASSERT_EQ(1650, *sums.find(2));
+    ASSERT_EQ(nullptr, sums.find(3));
+    ASSERT_EQ(0, sums.begin()->first); // entries are kept in insertion order
+
+    auto counts = getStream().map([](auto& e) { return std::to_string(e % 7); }).countBy([](auto& e) { return e; });
+    ASSERT_EQ(15u, counts["0"]);
+    ASSERT_EQ(14u, counts["6"]);
+    auto sorted = std::move(counts).sortedByKey(std::greater<>{});
+    ASSERT_EQ(7u, sorted.size());
+    ASSERT_EQ("6", sorted.front().first);
+    ASSERT_EQ(15u, sorted.back().second);
+
+    // the table grows well past its reserved size
+    auto distinct = streams::generate::counter(0).take(10000).countBy([](auto e) { return e * 1024; });
+    ASSERT_EQ(10000u, distinct.size());
+    ASSERT_EQ(1u, distinct.count(9999 * 1024));
+    ASSERT_EQ(0u, distinct.count(1));
+
+    auto groups = getStream().take(6).groupBy([](auto& e) { return e % 2 == 0; }, std::vector<int>{}, [](auto group, auto& e) {
+        group.push_back(e);
+        return group;
+    }).sortedByKey();
+    ASSERT_EQ((std::vector<int>{ 1, 3, 5 }), groups[0].second);
+    ASSERT_EQ((std::vector<int>{ 0, 2, 4 }), groups[1].second);
+}
+
+TEST_F(GeneralTests, Merge) {
+    std::vector<int> odd, even, tens{ 0, 10, 20 };
+    getStream().forEach([&odd, &even](auto& e) { (e % 2 ? odd : even).push_back(e); });
+
+    auto merged = streams::merge(std::less<>{}, streams::from(odd), streams::from(even), streams::from(tens));
+    ASSERT_EQ(103u, merged.sizeHint().lower);
+    ASSERT_EQ(0, *merged.next());
+    ASSERT_EQ(102u, *merged.sizeHint().upper);
+    std::vector<int> expected = vector;
+    expected.insert(expected.begin(), { 0, 10, 20 });
+    std::sort(expected.begin(), expected.end());
+    expected.erase(expected.begin());
+    ASSERT_EQ(expected, merged.collect());
+
+    // different pipelines, and equal elements keep the order of the sources
+    auto pairs = streams::merge([](auto& l, auto& r) { return l.first < r.first; },
+                                getStream().map([](auto& e) { return std::make_pair(e / 10, 'a'); }).take(30),
+                                streams::from(tens).map([](auto& e) { return std::make_pair(e / 10, 'b'); })).collect();
+    ASSERT_EQ(33u, pairs.size());
+    ASSERT_EQ(std::make_pair(1, 'a'), pairs[11]);
+    ASSERT_EQ(std::make_pair(1, 'b'), pairs[21]);
+    ASSERT_EQ(std::make_pair(2, 'b'), pairs.back());
+
+    auto started = streams::merge(std::less<>{}, getStream().map([](auto& e) { return e * 2; }), getStream().map([](auto& e) { return e * 3; }));
+    ASSERT_EQ(0, *started.next());
+    ASSERT_EQ(0, *started.next());
+    ASSERT_EQ((std::vector<int>{ 2, 3, 4 }), started.take(3).collect()); // a copy of a started merge
+
+    std::vector<std::vector<int>> shards(5);
+    for (int i = 0; i < 100; ++i) {
+        shards[static_cast<size_t>(i * 7 % 5)].push_back(99 - i);
+    }
+    std::vector<decltype(streams::from(shards[0]))> streams;
+    for (auto& shard : shards) {
+        streams.push_back(streams::from(shard));
+    }
+    std::vector<int> descending(vector.rbegin(), vector.rend());
+    ASSERT_EQ(descending, streams::merge(std::greater<>{}, streams).collect());
+    ASSERT_FALSE(streams::merge(std::less<>{}, std::vector<decltype(getStream())>{}).next());
+}
+
+namespace {
+    struct Customer {
+        int id;
+        std::string name;
+    };
+
+    struct Order {
+        int customer;
+        int total;
+    };
+
+    // reads values one at a time into a single slot, as stream readers do
+    struct SlotReader {
+        std::vector<int> values;
+        size_t next;
+        int slot;
+
+        bool read() {
+            if (next == values.size()) {
+                return false;
+            }
+            slot = values[next++];
+            return true;
+        }
+    };
+
+    // an input iterator: the element it refers to is overwritten by the next increment
+    struct SlotIterator {
+        using iterator_category = std::input_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        std::reference_wrapper<SlotReader> reader;
+        bool atEnd;
+
+        const int& operator*() const { return reader.get().slot; }
+        SlotIterator& operator++() { atEnd = !reader.get().read(); return *this; }
+        bool operator==(const SlotIterator& other) const { return atEnd == other.atEnd; }
+        bool operator!=(const SlotIterator& other) const { return atEnd != other.atEnd; }
+    };
+}
+
+TEST_F(GeneralTests, MergeJoin) {
+    const std::vector<Customer> customers{ { 1, "ann" }, { 2, "bob" }, { 4, "dan" }, { 5, "eve" } };
+    const std::vector<Order> orders{ { 0, 5 }, { 1, 10 }, { 1, 20 }, { 3, 30 }, { 4, 40 }, { 4, 41 }, { 6, 60 } };
+
+    auto joined = streams::from(orders).mergeJoin(streams::from(customers), [](auto& o) { return o.customer; }, [](auto& c) { return c.id; });
+    ASSERT_EQ(&orders[1], &std::get<0>(*joined.next()));
+    ASSERT_EQ(&customers[0], &std::get<1>(*joined.next())); // references into the sources
+    std::vector<std::string> names;
+    joined.forEach([&names](auto& pair) { names.push_back(std::get<1>(pair).name + std::to_string(std::get<0>(pair).total)); });
+    ASSERT_EQ((std::vector<std::string>{ "dan40", "dan41" }), names);
+
+    // many to many, right elements copied from a pipeline
+    auto pairs = getStream().map([](auto& e) { return e / 3; }).take(9)
+        .mergeJoin(getStream().map([](auto& e) { return e / 2; }), [](auto e) { return e; }, [](auto e) { return e; })
+        .map([](auto& t) { return std::get<0>(t) * 10 + std::get<1>(t); }).collect();
+    ASSERT_EQ((std::vector<int>{ 0, 0, 0, 0, 0, 0, 11, 11, 11, 11, 11, 11, 22, 22, 22, 22, 22, 22 }), pairs);
+
+    // descending keys
+    std::vector<int> down{ 5, 3, 3, 1 }, other{ 4, 3, 1, 0 };
+    ASSERT_EQ(3u, streams::from(down).mergeJoin(streams::from(other), [](int e) { return e; }, [](int e) { return e; }, std::greater<>{}).count());
+
+    // a group of elements read through an input iterator is copied, as the iterator reuses its element
+    using SlotExtractor = streams::SequenceStreamExtractor<SlotIterator>;
+    static_assert(!streams::traits::HasStableElements<SlotExtractor>::value, "");
+    static_assert(streams::traits::HasStableElements<decltype(getStream().extractor)>::value, "");
+    SlotReader reader{ { 1, 1, 3, 4, 4, 7 }, 0, 0 };
+    SlotIterator first{ reader, !reader.read() };
+    streams::BaseStreamInterface<SlotExtractor> read{ SlotExtractor(std::move(first), SlotIterator{ reader, true }) };
+    std::vector<int> matched;
+    getStream().mergeJoin(read, [](auto& e) { return e; }, [](auto& e) { return e; })
+        .forEach([&matched](auto& pair) { matched.push_back(std::get<1>(pair)); });
+    ASSERT_EQ((std::vector<int>{ 1, 1, 3, 4, 4, 7 }), matched);
+}
+
+TEST_F(GeneralTests, HashJoin) {
+    const std::vector<Customer> customers{ { 5, "eve" }, { 1, "ann" }, { 4, "dan" }, { 2, "bob" } };
+    const std::vector<Order> orders{ { 4, 40 }, { 1, 10 }, { 6, 60 }, { 4, 41 }, { 1, 20 } };
+
+    auto joined = streams::from(orders).hashJoin(streams::from(customers), [](auto& o) { return o.customer; }, [](auto& c) { return c.id; });
+    std::vector<std::string> names;
+    joined.forEach([&names](auto& pair) { names.push_back(std::get<1>(pair).name + std::to_string(std::get<0>(pair).total)); });
+    ASSERT_EQ((std::vector<std::string>{ "dan40", "ann10", "dan41", "ann20" }), names);
+
+    // the bounded side is loaded when the other one is infinite, pairs keep the left-right order
+    auto squares = streams::generate::counter(0).map([](auto e) { return static_cast<int>(e * e); })
+        .hashJoin(getStream(), [](auto e) { return e; }, [](auto& e) { return e; });
+    ASSERT_EQ(std::make_tuple(0, 0), *squares.next());
+    auto match = squares.nth(8);
+    ASSERT_EQ(std::make_tuple(81, 81), *match);
+    ASSERT_EQ(&vector[81], &std::get<1>(*match));
+
+    // several matches on both sides
+    auto tens = getStream().hashJoin(getStream().map([](auto& e) { return e % 5; }), [](auto& e) { return e; }, [](auto e) { return e; });
+    ASSERT_EQ(100u, tens.count());
+}
+
+namespace {
+    // a user-defined aggregator: the longest run of increasing elements
+    struct LongestAscent {
+        size_t longest = 0;
+        size_t current = 0;
+        int last = 0;
+
+        void add(int e) {
+            current = current != 0 && e > last ? current + 1 : 1;
+            last = e;
+            longest = std::max(longest, current);
+        }
+
+        size_t result() const { return longest; }
+    };
+}
+
+TEST_F(GeneralTests, Aggregate) {
+    using namespace streams::aggregators;
+
+    auto stats = getStream().filter([](auto& e) { return e % 2 == 0; }).aggregate<Count, Sum, Min, Max, Mean, Variance>();
+    ASSERT_EQ(50u, std::get<0>(stats).result());
+    ASSERT_EQ(2450, std::get<1>(stats).result());
+    ASSERT_EQ(0, std::get<2>(stats).result());
+    ASSERT_EQ(98, std::get<3>(stats).result());
+    ASSERT_DOUBLE_EQ(49.0, *std::get<4>(stats).result());
+    ASSERT_DOUBLE_EQ(833.0, *std::get<5>(stats).result());
+    ASSERT_DOUBLE_EQ(850.0, *std::get<5>(stats).sample());
+
+    auto empty = getStream().take(0).aggregate<Count, Min, Mean, Variance>();
+    ASSERT_EQ(0u, std::get<0>(empty).result());
+    ASSERT_FALSE(std::get<1>(empty).result());
+    ASSERT_FALSE(std::get<2>(empty).result());
+    ASSERT_FALSE(std::get<3>(empty).sample());
+
+    std::vector<int> zigzag{ 3, 1, 2, 3, 4, 0, 5 };
+    auto custom = streams::from(zigzag).aggregate(LongestAscent{}, Sum<long>{}, Extremum<int, std::greater<int>>{});
+    ASSERT_EQ(4u, std::get<0>(custom).result());
+    ASSERT_EQ(18, std::get<1>(custom).result());
+    ASSERT_EQ(5, std::get<2>(custom).result());
+
+    // partial results of parallel parts are merged
+    auto parallel = getStream().map([](auto& e) { return e * 2; }).parallel(4).aggregate<Count, Sum, Max, Mean, Variance>();
+    ASSERT_EQ(100u, std::get<0>(parallel).result());
+    ASSERT_EQ(9900, std::get<1>(parallel).result());
+    ASSERT_EQ(198, std::get<2>(parallel).result());
+    ASSERT_DOUBLE_EQ(99.0, *std::get<3>(parallel).result());
+    ASSERT_DOUBLE_EQ(3333.0, *std::get<4>(parallel).result());
+}
+
+TEST_F(GeneralTests, Dedup) {
+    std::vector<int> runs{ 1, 1, 2, 2, 2, 3, 1, 1 };
+    auto unique = streams::from(runs).dedup();
+    ASSERT_EQ(1u, unique.sizeHint().lower);
+    ASSERT_EQ((std::vector<int>{ 1, 2, 3, 1 }), unique.collect());
+    ASSERT_EQ(10u, getStream().map([](auto& e) { return e / 10; }).dedup().count());
+    ASSERT_EQ((std::vector<int>{ 0, 10, 20 }), getStream().dedup([](auto& l, auto& r) { return l / 10 == r / 10; }).take(3).collect());
+
+    std::vector<int> shard{ 1, 2, 3, 5 }, other{ 2, 3, 4 };
+    ASSERT_EQ((std::vector<int>{ 1, 2, 3, 4, 5 }), streams::merge(std::less<>{}, streams::from(shard), streams::from(other)).dedup().collect());
+}
+
+namespace {
+    // a pipeline picked at run time behind a non-template interface
+    streams::AnyStream<int> evenOrOdd(const std::vector<int>& vec, bool even) {
+        if (even) {
+            return streams::from(vec).filter([](auto& e) { return e % 2 == 0; });
+        }
+        return streams::from(vec).filter([](auto& e) { return e % 2 == 1; }).map([](auto& e) { return e * 10; });
+    }
+}
+
+TEST_F(GeneralTests, AnyStream) {
+    auto even = evenOrOdd(vector, true);
+    ASSERT_TRUE(even.extractor.local());
+    ASSERT_EQ(0, *even.next());
+    ASSERT_EQ(2, *even.next());
+    ASSERT_EQ(48u, even.count());
+    ASSERT_EQ(990, evenOrOdd(vector, false).skip(49).next());
+    ASSERT_FALSE(evenOrOdd(vector, false).skip(50).next());
+
+    // batches are resumed where the previous one stopped
+    streams::AnyStream<int> batched(getStream().map([](auto& e) { return e + 1; }), 7);
+    ASSERT_EQ(100u, batched.sizeHint().lower);
+    ASSERT_EQ(1, *batched.next());
+    ASSERT_EQ(99u, batched.sizeHint().lower);
+    ASSERT_EQ(5050, batched.fold(1, std::plus<>{}));
+
+    // the batch is stored in the stream, its size is capped by the capacity
+    streams::AnyStream<int> reused(getStream(), 16);
+    ASSERT_EQ(16u, reused.extractor.batchSize);
+    ASSERT_EQ(16u, streams::AnyStream<int>(getStream(), 100).extractor.batchSize);
+    ASSERT_EQ(100u, (streams::AnyStream<int, 128>(getStream(), 100).extractor.batchSize));
+    ASSERT_EQ(0, *reused.next());
+    auto reusedCopy = reused;
+    ASSERT_EQ(1, *reusedCopy.next());
+    ASSERT_EQ(reusedCopy.extractor.batch() + 1, reusedCopy.extractor.get_impl()); // in the stream itself
+    ASSERT_EQ(99u, reused.count());
+    ASSERT_EQ(98u, reusedCopy.count());
+
+    // elements in the batch are copied, moved and destroyed with the stream
+    streams::AnyStream<std::string> strings(getStream().map([](auto& e) { return std::to_string(e); }), 8);
+    ASSERT_EQ("0", *strings.next());
+    auto stringsCopy = strings;
+    auto stringsMoved = std::move(strings);
+    ASSERT_FALSE(strings.next());
+    ASSERT_EQ("1", *stringsCopy.next());
+    ASSERT_EQ("1", *stringsMoved.next());
+    stringsCopy = stringsMoved;
+    ASSERT_EQ("2", *stringsCopy.next());
+    ASSERT_EQ(97u, stringsMoved.skip(1).count());
+
+    // a pipeline larger than the buffer goes to the heap; copies and moves keep their position
+    std::vector<int> other(vector.rbegin(), vector.rend());
+    auto sums = getStream().zip(streams::from(other)).zip(getStream()).map([](auto& t) {
+        return static_cast<long>(std::get<0>(std::get<0>(t)) + std::get<1>(std::get<0>(t)) + std::get<1>(t));
+    });
+    ASSERT_TRUE(streams::AnyStream<long>(sums).extractor.local());
+    streams::AnyStream<long, 16, 64> zipped = sums;
+    ASSERT_FALSE(zipped.extractor.local());
+    ASSERT_EQ(99, *zipped.next());
+    auto copy = zipped;
+    ASSERT_EQ(100, *copy.next());
+    ASSERT_EQ(100, *zipped.next());
+    auto moved = std::move(copy);
+    ASSERT_EQ(101, *moved.next());
+    ASSERT_FALSE(copy.next());
+
+    std::vector<streams::AnyStream<int>> parts;
+    parts.emplace_back(getStream().take(2));
+    parts.emplace_back(streams::generate::counter(5).map([](auto e) { return static_cast<int>(e); }).take(1));
+    ASSERT_EQ((std::vector<int>{ 0, 1 }), parts[0].collect());
+    ASSERT_EQ(5, parts[1].next());
+    parts[0] = parts[1];
+    ASSERT_FALSE(parts[0].next());
+}
+
+TEST_F(GeneralTests, Profiled) {
+    std::vector<streams::StageProfile> stages;
+    auto keep = [&stages](const streams::PipelineProfile& profile) { stages = profile.stages; };
+
+    const size_t count = getStream()
+        .profiled("source", keep)
+        .filter([](auto& e) { return e % 4 == 0; })
+        .profiled("filter", keep)
+        .map([](auto& e) { return e * 2; })
+        .profiled("map", keep)
+        .take(10)
+        .count();
+    ASSERT_EQ(10u, count);
+    ASSERT_EQ(3u, stages.size());
+    ASSERT_EQ("source", stages[0].name);
+    ASSERT_EQ(37u, stages[0].produced);
+    ASSERT_EQ(10u, stages[1].produced);
+    ASSERT_EQ(10u, stages[2].pulls);
+    ASSERT_EQ(10u, stages[2].produced);
+    ASSERT_LE(stages[1].time, stages[2].time);
+
+    std::string table;
+    {
+        auto stream = streams::generate::counter(0).profiled("counter", [&table](auto& profile) { table = profile.table(); });
+        stream.filter([](auto e) { return e % 3 == 0; }).profiled("multiples of 3").nth(5);
+        ASSERT_TRUE(table.empty()); // `stream` still shares the profile
+    }
+    ASSERT_NE(std::string::npos, table.find("multiples of 3"));
+    ASSERT_NE(std::string::npos, table.find("0.3750"));
+
+    // the capabilities of the source are kept: block-wise terminals, parallel parts and skipping
+    using Profiled = decltype(getStream().profiled("vector", keep).extractor);
+    static_assert(Profiled::blockwise && Profiled::randomAccess && Profiled::splittable, "");
+    ASSERT_EQ(50u, getStream().profiled("vector", keep).filter([](auto& e) { return e % 2 == 0; }).count());
+    ASSERT_EQ(100u, stages[0].produced);
+    ASSERT_EQ(4950, getStream().profiled("vector", keep).parallel(4).fold(0, std::plus<>{}, std::plus<>{}));
+    ASSERT_EQ(100u, stages[0].produced);
+    ASSERT_EQ(90, *getStream().profiled("vector", keep).skip(90).next());
+    ASSERT_EQ(91u, stages[0].pulls);
+    ASSERT_EQ(91u, stages[0].produced);
+
+    // counters are kept by the stage until it is destroyed, copies count on their own
+    {
+        auto stream = getStream().profiled("vector", keep);
+        ASSERT_EQ(4, *stream.nth(4));
+        auto copy = stream;
+        ASSERT_EQ(95u, copy.count());
+        ASSERT_EQ(5u, stream.extractor.pulls);
+        ASSERT_EQ(96u, copy.extractor.pulls);
+        ASSERT_EQ(91u, stages[0].pulls);
+    }
+    ASSERT_EQ(101u, stages[0].pulls);
+    ASSERT_EQ(100u, stages[0].produced);
+}
+
+TEST_F(GeneralTests, ParMap) {
+    auto squares = getStream().parMap([](auto& e) { return e * e; }, 3, 4);
+    ASSERT_EQ(100u, squares.sizeHint().lower);
+    ASSERT_EQ(0, *squares.next());
+    ASSERT_EQ(99u, squares.sizeHint().lower);
+    ASSERT_EQ(99u, *squares.sizeHint().upper);
+    ASSERT_EQ(1, *squares.next());
+    ASSERT_EQ(328349, squares.fold(0, std::plus<>{}));
+
+    std::vector<std::string> expected;
+    for (int e : vector) {
+        expected.push_back(std::to_string(e));
+    }
+    ASSERT_EQ(expected, getStream().parMap([](auto& e) { return std::to_string(e); }).collect());
+    ASSERT_EQ(50u, getStream().parMap([](auto& e) { return e; }, 2, 7).filter([](auto& e) { return e % 2 == 0; }).count());
+    ASSERT_FALSE(getStream().take(0).parMap([](auto& e) { return e; }).next());
+
+    // an infinite source is read a bounded number of windows ahead
+    auto doubled = streams::generate::counter(0).parMap([](auto e) { return e * 2; }, 4, 8).skip(1000);
+    ASSERT_EQ(2000, *doubled.next());
+
+    auto failing = getStream().parMap([](auto& e) {
+        if (e == 50) {
+            throw std::runtime_error("bad element");
+        }
+        return e;
+    }, 2, 5);
+    ASSERT_EQ(10, *failing.nth(10));
+    ASSERT_THROW(failing.count(), std::runtime_error);
+}
+
+TEST_F(GeneralTests, ParMapCopy) {
+    auto original = getStream().parMap([](auto& e) { return e * 2; }, 2, 4);
+    ASSERT_EQ(0, *original.next());
+    auto copy = original;
+    ASSERT_EQ(2, *original.next());
+    ASSERT_EQ(9898, original.fold(0, std::plus<>{}));
+    ASSERT_FALSE(original.next());
+
+    // the copy goes on from the element after the current one on workers of its own
+    ASSERT_EQ(99u, copy.sizeHint().lower);
+    ASSERT_EQ(99u, *copy.sizeHint().upper);
+    ASSERT_EQ(2, *copy.next());
+    auto copyOfCopy = copy;
+    ASSERT_EQ(97u, copy.skip(1).count());
+    ASSERT_EQ(4, *copyOfCopy.next());
+    ASSERT_EQ(9894, copyOfCopy.fold(0, std::plus<>{}));
+}
+
+TEST_F(GeneralTests, Buffered) {
+    auto squares = getStream().map([](auto& e) { return e * e; }).buffered(8);
+    ASSERT_EQ(100u, squares.sizeHint().lower);
+    ASSERT_EQ(0, *squares.next());
+    ASSERT_EQ(99u, squares.sizeHint().lower);
+    ASSERT_EQ(328350, squares.fold(0, std::plus<>{}));
+
+    std::vector<int> expected(vector.begin() + 1, vector.end());
+    ASSERT_EQ(expected, getStream().filter([](auto& e) { return e > 0; }).buffered(1).collect());
+
+    // the producer stops once the consumer is gone
+    std::atomic<size_t> produced{ 0 };
+    {
+        auto infinite = streams::generate::counter(0).inspect([&produced](auto&) { ++produced; }).buffered(16);
+        ASSERT_EQ(7, *infinite.find([](auto& e) { return e == 7; }));
+    }
+    ASSERT_GE(16u + 8u + 1u, produced.load());
+    ASSERT_EQ(2u, getStream().buffered(4).take(2).count());
+
+    auto failing = getStream().map([](auto& e) {
+        if (e == 50) {
+            throw std::runtime_error("bad element");
+        }
+        return e;
+    }).buffered(4);
+    ASSERT_EQ(49, *failing.nth(49));
+    ASSERT_THROW(failing.next(), std::runtime_error);
+
+    // a copy of a started stream continues on its own channel, both can be advanced
+    auto original = getStream().buffered(4);
+    ASSERT_EQ(10, *original.nth(10));
+    auto copy = original;
+    ASSERT_EQ(11, *copy.next());
+    ASSERT_EQ(11, *original.next());
+    ASSERT_EQ(12, *original.next());
+    ASSERT_EQ(88u, copy.count());
+    ASSERT_EQ(87u, original.count());
+}
+
+TEST_F(GeneralTests, Split) {
+    ASSERT_EQ((std::vector<streams::StringView>{ "a", "bc", "", "d" }), streams::split("a,bc,,d", ',').collect());
+    ASSERT_EQ((std::vector<streams::StringView>{ "a", "" }), streams::split("a,", ',').collect());
+    ASSERT_EQ(1u, streams::split("", ',').count());
+
+    const std::string text = "first\r\nsecond\n\nlast";
+    auto lines = streams::lines(text);
+    ASSERT_EQ(1u, lines.sizeHint().lower);
+    ASSERT_EQ("first", *lines.next());
+    ASSERT_EQ(text.data() + 7, lines.next()->data()); // views into the text
+    ASSERT_EQ((std::vector<streams::StringView>{ "", "last" }), lines.collect());
+    ASSERT_EQ(2u, streams::lines("a\nb\n").count());
+    ASSERT_EQ(0u, streams::lines("").count());
+
+    auto owned = streams::lines(std::string("x\ny"));
+    ASSERT_EQ("y", *owned.nth(1));
+    ASSERT_EQ(3u, streams::split(std::string(100, ' '), ' ').filter([](auto& e) { return e.empty(); }).skip(98).count());
+}
+
+#ifdef STREAMS_HAS_MMAP
+namespace {
+    struct Record {
+        int id;
+        double value;
+    };
+}
+
+TEST_F(GeneralTests, MappedFile) {
+    const std::string path = ::testing::TempDir() + "streams_records.bin";
+    {
+        std::ofstream file(path, std::ios::binary);
+        for (int i = 0; i < 1000; ++i) {
+            const Record record{ i, i * 0.5 };
+            file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+        file.write("tail", 4); // a partial record
+    }
+
+    auto records = streams::fromMappedFile<Record>(path);
+    ASSERT_EQ(1000u, records.sizeHint().lower);
+    ASSERT_EQ(10, records.nth(10)->id);
+    ASSERT_EQ(989u, records.count());
+
+    ASSERT_EQ(499500, streams::fromMappedFile<Record>(path).map([](auto& r) { return r.id; }).fold(0, std::plus<>{}));
+    ASSERT_EQ(499.5, streams::fromMappedFile<Record>(path).map([](auto& r) { return r.value; }).max());
+    ASSERT_EQ(249750.0, streams::fromMappedFile<Record>(path).map([](auto& r) { return r.value; }).parallel(4).fold(0.0, std::plus<>{}, std::plus<>{}));
+    ASSERT_EQ(998, streams::fromMappedFile<Record>(path).skip(998).next()->id);
+
+    auto ints = streams::fromMappedFile<int>(path);
+    ASSERT_EQ(1000u * sizeof(Record) / sizeof(int) + 1, ints.count());
+
+    {
+        std::ofstream file(path, std::ios::trunc);
+        file << "GET /index.html 200\nGET /missing 404\r\nPOST /form 200\n";
+    }
+    auto statuses = streams::linesFromFile(path).map([](auto& line) { return line.substr(line.rfind(' ') + 1); });
+    ASSERT_EQ((std::vector<streams::StringView>{ "200", "404", "200" }), statuses.collect());
+
+    std::ofstream(path, std::ios::trunc);
+    ASSERT_FALSE(streams::fromMappedFile<Record>(path).next());
+    ASSERT_FALSE(streams::linesFromFile(path).next());
+    std::remove(path.c_str());
+
+    ASSERT_THROW(streams::fromMappedFile<Record>(path), std::system_error);
+}
+#endif
+
+namespace {
+    // counts the allocations of every allocator copied from it
+    template<typename T>
+    struct CountingAllocator {
+        using value_type = T;
+
+        std::shared_ptr<size_t> allocations;
+
+        explicit CountingAllocator(std::shared_ptr<size_t> allocations) : allocations(std::move(allocations)) {}
+
+        template<typename U>
+        CountingAllocator(const CountingAllocator<U>& other) : allocations(other.allocations) {}
+
+        T* allocate(size_t n) {
+            ++*allocations;
+            return std::allocator<T>().allocate(n);
+        }
+
+        void deallocate(T* p, size_t n) {
+            std::allocator<T>().deallocate(p, n);
+        }
+
+        template<typename U>
+        bool operator == (const CountingAllocator<U>& other) const { return allocations == other.allocations; }
+
+        template<typename U>
+        bool operator != (const CountingAllocator<U>& other) const { return allocations != other.allocations; }
+    };
+}
+
+TEST_F(GeneralTests, CollectInto) {
+    std::vector<int> buffer;
+    getStream().take(10).collectInto(buffer);
+    ASSERT_EQ((std::vector<int>{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }), buffer);
+
+    // capacity is reused
+    const int* data = buffer.data();
+    ASSERT_EQ((std::vector<int>{ 7, 8, 9 }), getStream().skip(7).take(3).collectInto(buffer));
+    ASSERT_EQ(data, buffer.data());
+
+    getStream().skip(98).appendTo(buffer);
+    ASSERT_EQ((std::vector<int>{ 7, 8, 9, 98, 99 }), buffer);
+
+    std::list<int> list{ -1 };
+    getStream().filter([](auto& e) { return e < 2; }).appendTo(list);
+    ASSERT_EQ((std::list<int>{ -1, 0, 1 }), list);
+}
+
+TEST_F(GeneralTests, CollectWithAllocator) {
+    auto allocations = std::make_shared<size_t>(0);
+    CountingAllocator<char> allocator(allocations);
+
+    auto vec = getStream().collect(allocator);
+    ASSERT_EQ(1u, *allocations);
+    ASSERT_TRUE((std::is_same<std::vector<int, CountingAllocator<int>>, decltype(vec)>::value));
+    ASSERT_TRUE(std::equal(vec.begin(), vec.end(), vector.begin(), vector.end()));
+
+    auto list = getStream().take(3).collect<std::list>(allocator);
+    ASSERT_EQ(3, std::distance(list.begin(), list.end()));
+    ASSERT_EQ(2, list.back());
+
+    *allocations = 0;
+    auto parts = getStream().partition([](auto& e) { return e % 2 == 0; }, allocator);
+    ASSERT_EQ(2u, *allocations);
+    ASSERT_EQ(50u, parts.first.size());
+    ASSERT_EQ(99, parts.second.back());
+    ASSERT_EQ(100u, parts.first.capacity() + parts.second.capacity());
+
+    // the size hint is split between the sides rather than reserved for both
+    auto skewed = getStream().partition([](auto& e) { return e < 90; }, allocator);
+    ASSERT_EQ(90u, skewed.first.size());
+    ASSERT_EQ(50u, skewed.second.capacity());
+}
+
+namespace {
+    // C++14 lambdas can't be used in constant expressions, function objects can
+    struct Square {
+        constexpr size_t operator()(size_t e) const { return e * e; }
+    };
+
+    struct IsOdd {
+        template<typename T>
+        constexpr bool operator()(T e) const { return e % 2 == 1; }
+    };
+
+    constexpr int primes[] = { 7, 2, 11, 3, 13, 5 };
+}
+
+// compilers without __builtin_is_constant_evaluated() check the same pipelines at run time
+#ifdef STREAMS_HAS_CONSTANT_EVALUATION
+#define CONSTANT_ASSERT(...) static_assert(__VA_ARGS__, "")
+#define CONSTANT constexpr
+#else
+#define CONSTANT_ASSERT(...) ASSERT_TRUE((__VA_ARGS__))
+#define CONSTANT const
+#endif
+
+TEST_F(GeneralTests, Constexpr) {
+    CONSTANT auto squares = streams::generate::counter().map(Square()).take(8).collectArray<10>();
+    CONSTANT_ASSERT(squares[0] == 0 && squares[3] == 9 && squares[7] == 49 && squares[9] == 0);
+    CONSTANT_ASSERT(streams::generate::counter(1).filter(IsOdd()).take(5).fold(size_t{ 0 }, std::plus<>()) == 25);
+    CONSTANT_ASSERT(streams::generate::counter().filter(IsOdd()).map(Square()).map(Square()).skip(1).take(1).fold(size_t{ 0 }, std::plus<>()) == 81);
+    CONSTANT_ASSERT(streams::generate::counter().skip(3).map(Square()).find(IsOdd()) == streams::Optional<size_t>(9));
+    CONSTANT_ASSERT(streams::generate::counter(2).position(IsOdd()) == streams::Optional<size_t>(2));
+    CONSTANT_ASSERT(streams::generate::counter().map(Square()).any(IsOdd()));
+
+    CONSTANT_ASSERT(streams::from(primes).count() == 6);
+    CONSTANT_ASSERT(streams::from(primes).min() == streams::Optional<int>(2));
+    CONSTANT_ASSERT(streams::from(primes).max() == streams::Optional<int>(13));
+    CONSTANT_ASSERT(!streams::from(primes).skip(1).take(1).all(IsOdd()));
+
+    // the same pipelines at run time
+    auto runtime = streams::generate::counter().map(Square()).take(8).collectArray<10>();
+    ASSERT_EQ((std::array<size_t, 10>{ { 0, 1, 4, 9, 16, 25, 36, 49, 0, 0 } }), runtime);
+    ASSERT_EQ(2, *streams::from(primes).min());
+    ASSERT_EQ(4u, *streams::from(primes).position([](int e) { return e == 3; }));
+}
+
+#undef CONSTANT_ASSERT
+#undef CONSTANT
 
 namespace streams {
     template<typename T>